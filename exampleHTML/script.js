@@ -1,4 +1,6 @@
 const serverAddress = "%SERVER_PROTOCOL%://%SERVER_ADDRESS%:%SERVER_PORT%";
+const maxPublicKeysPerRequest = 256;
+const directoryPageSize = 200;
 
 let publicKey = "";
 let privateKey = "";
@@ -7,6 +9,12 @@ let socket = null;
 let token = null;
 let currentUser = null;
 let users = {};
+let publicKeys = {};
+// Fingerprints of keys requested but not received yet, by user id.
+let requestedKeys = {};
+// Active users collected while paging through the directory, and presence changes received meanwhile.
+let directoryPages = null;
+let queuedPresence = [];
 let messageHistory = {};
 let unreadMessages = {};
 
@@ -139,7 +147,11 @@ function sendMessage() {
     let messageType = ["message", "sent"];
 
     try {
-      message = encryptMessage(currentUser.publicKey, messageValue); 
+      if (!publicKeys[currentUser.id]) {
+        throw "public key of this user is not loaded yet.";
+      }
+
+      message = encryptMessage(publicKeys[currentUser.id].publicKey, messageValue); 
       socket.send(JSON.stringify({ action: Requests.MessageRequest, token: token, target: currentUser.id, message: message }));
 
       if (!messageHistory[currentUser.id]) {
@@ -242,7 +254,12 @@ function init() {
     privateKey = KEYUTIL.getKey(sessionStorage.getItem("prvKey"));
     token = storedToken;
     socket.onopen = () => {
-      socket.send(JSON.stringify({ action: Requests.AuthorizeRequest, token: token }));
+      const request = { action: Requests.AuthorizeRequest, token: token };
+      const lastSeq = sessionStorage.getItem("lastSeq");
+      if (lastSeq !== null) {
+        request.lastSeq = Number(lastSeq);
+      }
+      socket.send(JSON.stringify(request));
     };
   }
   
@@ -260,6 +277,10 @@ function handleAuth(data) {
   if (data.valid) {
     document.getElementById("loginForm").classList.add("hidden");
     document.getElementById("chat").classList.remove("hidden");
+    // Only in directory presence mode, otherwise the whole list arrives as a UserlistChangeEvent.
+    if (data.directory) {
+      requestDirectory();
+    }
   } else {
     logout();
   }
@@ -277,6 +298,9 @@ function handleLogin(data) {
 
     document.getElementById("loginForm").classList.add("hidden");
     document.getElementById("chat").classList.remove("hidden");
+    if (data.directory) {
+      requestDirectory();
+    }
   } else {
     document.getElementById("formError").textContent = data.error;
   }
@@ -299,20 +323,117 @@ function handleUserlistChange(data) {
     }
 
     users = data.users;
+    const missingKeys = [];
     for (const user of users) {
       const userId = user.id;
 
       if (!unreadMessages[userId]) {
         unreadMessages[userId] = 0;
       }
+
+      const knownKey = publicKeys[userId];
+      if (user.keyFingerprint && (!knownKey || knownKey.keyFingerprint !== user.keyFingerprint)
+          && requestedKeys[userId] !== user.keyFingerprint) {
+        missingKeys.push(userId);
+        requestedKeys[userId] = user.keyFingerprint;
+      }
     }
 
+    requestPublicKeys(missingKeys);
+
     displayUsers();
   }
 }
 
+function requestDirectory(cursor) {
+  if (!socket || !token) {
+    return;
+  }
+
+  if (!cursor) {
+    directoryPages = [];
+  }
+
+  const request = { action: Requests.DirectoryRequest, token: token, limit: directoryPageSize };
+  if (cursor) {
+    request.cursor = cursor;
+  }
+  socket.send(JSON.stringify(request));
+}
+
+function handleDirectory(data) {
+  if (!data.valid || directoryPages === null) {
+    return;
+  }
+
+  directoryPages.push(...(data.users || []));
+  if (data.cursor) {
+    requestDirectory(data.cursor);
+    return;
+  }
+
+  // Complete, changes that arrived while paging apply on top of it.
+  const list = directoryPages;
+  const pending = queuedPresence;
+  directoryPages = null;
+  queuedPresence = [];
+
+  handleUserlistChange({ users: list });
+  pending.forEach(handlePresence);
+}
+
+function handlePresence(data) {
+  if (!data.valid) {
+    return;
+  }
+
+  if (directoryPages !== null) {
+    queuedPresence.push(data);
+    return;
+  }
+
+  // Contact presence arrives as changes to single users rather than as a complete list.
+  const changed = data.users || [];
+  const removed = data.removed || [];
+  const list = (Array.isArray(users) ? users : []).filter(user => !removed.includes(user.id) && !changed.some(change => change.id === user.id));
+  for (const user of changed) {
+    if (user.online) {
+      list.push(user);
+    }
+  }
+
+  handleUserlistChange({ users: list });
+}
+
+function requestPublicKeys(ids) {
+  if (!socket || !token) {
+    return;
+  }
+
+  // The server answers at most maxPublicKeysPerRequest keys per request.
+  for (let i = 0; i < ids.length; i += maxPublicKeysPerRequest) {
+    const batch = ids.slice(i, i + maxPublicKeysPerRequest);
+    socket.send(JSON.stringify({ action: Requests.PublicKeysRequest, token: token, target: batch.join(",") }));
+  }
+}
+
+function handlePublicKeys(data) {
+  if (data.valid && data.keys) {
+    for (const key of data.keys) {
+      publicKeys[key.id] = key;
+      delete requestedKeys[key.id];
+    }
+  } else {
+    // Let the next user list ask again.
+    requestedKeys = {};
+  }
+}
+
 function handleServerMessage(event) {
   const data = JSON.parse(event.data);
+  if (typeof data.seq === "number") {
+    sessionStorage.setItem("lastSeq", data.seq);
+  }
   switch(data.event) {
   case Responses.InvalidUserEvent:
     logout();
@@ -331,6 +452,15 @@ function handleServerMessage(event) {
   case Responses.UserlistChangeEvent:
     handleUserlistChange(data);
     break;
+  case Responses.PublicKeysEvent:
+    handlePublicKeys(data);
+    break;
+  case Responses.PresenceEvent:
+    handlePresence(data);
+    break;
+  case Responses.DirectoryEvent:
+    handleDirectory(data);
+    break;
   default:
     console.warn("Unknown message type", data.event, data);
     break;
@@ -0,0 +1,587 @@
+#include "ChatRequest.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+
+#include <cstring>
+
+namespace {
+
+const char *const fieldNames[ChatRequest::FieldCount] = {
+    "action",
+    "limit",
+    "lastSeq",
+    "size",
+    "credit",
+    "token",
+    "target",
+    "message",
+    "name",
+    "password",
+    "pubKey",
+    "cursor"
+};
+
+const int maxNestingDepth = 64;
+const int maxIntegerDigits = 9;
+
+class JsonScanner
+{
+public:
+    JsonScanner(const char *data, int size)
+        : m_data(data)
+        , m_size(size)
+    {
+    }
+
+    bool atEnd() const
+    {
+        return m_pos >= m_size;
+    }
+
+    char peek() const
+    {
+        return atEnd() ? '\0' : m_data[m_pos];
+    }
+
+    bool consume(char expected)
+    {
+        skipWhitespace();
+        if (peek() != expected) {
+            return false;
+        }
+
+        ++m_pos;
+        return true;
+    }
+
+    void skipWhitespace()
+    {
+        while (!atEnd()) {
+            const char c = m_data[m_pos];
+            if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+                return;
+            }
+            ++m_pos;
+        }
+    }
+
+    // Leaves the cursor after the closing quote. begin/length describe the raw contents.
+    bool scanString(int &begin, int &length, bool &escaped)
+    {
+        skipWhitespace();
+        if (peek() != '"') {
+            return false;
+        }
+
+        begin = ++m_pos;
+        escaped = false;
+
+        while (!atEnd()) {
+            const uchar c = static_cast<uchar>(m_data[m_pos]);
+            if (c == '"') {
+                length = m_pos - begin;
+                ++m_pos;
+                return true;
+            }
+
+            if (c < 0x20) {
+                return false;
+            }
+
+            // QString::fromUtf8() would quietly replace invalid sequences, QJsonDocument rejects them.
+            if (c >= 0x80 && !skipUtf8Sequence()) {
+                return false;
+            }
+
+            if (c == '\\') {
+                escaped = true;
+                if (++m_pos >= m_size) {
+                    return false;
+                }
+
+                const char e = m_data[m_pos];
+                if (e == 'u') {
+                    if (m_pos + 4 >= m_size) {
+                        return false;
+                    }
+
+                    for (int i = 1; i <= 4; ++i) {
+                        if (!isHexDigit(m_data[m_pos + i])) {
+                            return false;
+                        }
+                    }
+
+                    m_pos += 4;
+                } else if (!std::strchr("\"\\/bfnrt", e) || e == '\0') {
+                    return false;
+                }
+            }
+
+            ++m_pos;
+        }
+
+        return false;
+    }
+
+    // Leaves the cursor on the last byte of the multi-byte sequence starting at it. Overlong
+    // forms, surrogates and code points above U+10FFFF are invalid.
+    bool skipUtf8Sequence()
+    {
+        const uchar lead = static_cast<uchar>(m_data[m_pos]);
+
+        int continuationBytes = 0;
+        uint codePoint = 0;
+        uint minimum = 0;
+        if (lead >= 0xc2 && lead <= 0xdf) {
+            continuationBytes = 1;
+            codePoint = lead & 0x1f;
+            minimum = 0x80;
+        } else if ((lead & 0xf0) == 0xe0) {
+            continuationBytes = 2;
+            codePoint = lead & 0x0f;
+            minimum = 0x800;
+        } else if (lead >= 0xf0 && lead <= 0xf4) {
+            continuationBytes = 3;
+            codePoint = lead & 0x07;
+            minimum = 0x10000;
+        } else {
+            return false;
+        }
+
+        if (m_size - m_pos <= continuationBytes) {
+            return false;
+        }
+
+        for (int i = 1; i <= continuationBytes; ++i) {
+            const uchar c = static_cast<uchar>(m_data[m_pos + i]);
+            if ((c & 0xc0) != 0x80) {
+                return false;
+            }
+            codePoint = (codePoint << 6) | (c & 0x3f);
+        }
+
+        if (codePoint < minimum || codePoint > 0x10ffff || (codePoint >= 0xd800 && codePoint <= 0xdfff)) {
+            return false;
+        }
+
+        m_pos += continuationBytes;
+        return true;
+    }
+
+    // Accepts any JSON number, integer tells whether it had neither fraction nor exponent.
+    bool scanNumber(int &begin, int &length, bool &integer)
+    {
+        skipWhitespace();
+        begin = m_pos;
+        integer = true;
+
+        if (peek() == '-') {
+            ++m_pos;
+        }
+
+        if (peek() == '0') {
+            ++m_pos;
+        } else if (isDigit(peek())) {
+            while (isDigit(peek())) {
+                ++m_pos;
+            }
+        } else {
+            return false;
+        }
+
+        if (peek() == '.') {
+            integer = false;
+            ++m_pos;
+            if (!isDigit(peek())) {
+                return false;
+            }
+            while (isDigit(peek())) {
+                ++m_pos;
+            }
+        }
+
+        if (peek() == 'e' || peek() == 'E') {
+            integer = false;
+            ++m_pos;
+            if (peek() == '+' || peek() == '-') {
+                ++m_pos;
+            }
+            if (!isDigit(peek())) {
+                return false;
+            }
+            while (isDigit(peek())) {
+                ++m_pos;
+            }
+        }
+
+        length = m_pos - begin;
+        return true;
+    }
+
+    bool skipValue(int depth = 0)
+    {
+        if (depth > maxNestingDepth) {
+            return false;
+        }
+
+        skipWhitespace();
+
+        int begin = 0;
+        int length = 0;
+        bool flag = false;
+
+        switch (peek()) {
+        case '"':
+            return scanString(begin, length, flag);
+        case '{':
+            ++m_pos;
+            if (consume('}')) {
+                return true;
+            }
+            do {
+                if (!scanString(begin, length, flag) || !consume(':') || !skipValue(depth + 1)) {
+                    return false;
+                }
+            } while (consume(','));
+            return consume('}');
+        case '[':
+            ++m_pos;
+            if (consume(']')) {
+                return true;
+            }
+            do {
+                if (!skipValue(depth + 1)) {
+                    return false;
+                }
+            } while (consume(','));
+            return consume(']');
+        case 't':
+            return skipLiteral("true");
+        case 'f':
+            return skipLiteral("false");
+        case 'n':
+            return skipLiteral("null");
+        default:
+            return scanNumber(begin, length, flag);
+        }
+    }
+
+    static bool isDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    static bool isHexDigit(char c)
+    {
+        return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+    }
+
+private:
+    bool skipLiteral(const char *literal)
+    {
+        const int length = static_cast<int>(std::strlen(literal));
+        if (m_size - m_pos < length || std::memcmp(m_data + m_pos, literal, length) != 0) {
+            return false;
+        }
+
+        m_pos += length;
+        return true;
+    }
+
+private:
+    const char *m_data = nullptr;
+    int m_size = 0;
+    int m_pos = 0;
+};
+
+int fieldForKey(const char *key, int length)
+{
+    for (int field = 0; field < ChatRequest::FieldCount; ++field) {
+        if (static_cast<int>(std::strlen(fieldNames[field])) == length
+                && std::memcmp(fieldNames[field], key, length) == 0) {
+            return field;
+        }
+    }
+
+    return -1;
+}
+
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+
+    return c - 'A' + 10;
+}
+
+}
+
+ChatRequest ChatRequest::fromJson(const QByteArray &json)
+{
+    ChatRequest request;
+    if (decode(json, request)) {
+        return request;
+    }
+
+    return fromJsonObject(QJsonDocument::fromJson(json).object());
+}
+
+ChatRequest ChatRequest::fromJsonObject(const QJsonObject &object)
+{
+    ChatRequest request;
+    for (int field = Action; field < Token; ++field) {
+        const QJsonValue value = object[QLatin1String(fieldNames[field])];
+        if (value.isDouble()) {
+            request.m_integers[field] = value.toInt();
+            request.m_integerFields |= 1u << field;
+        }
+    }
+
+    for (int field = Token; field < FieldCount; ++field) {
+        request.m_values[field] = object[QLatin1String(fieldNames[field])].toString();
+    }
+
+    return request;
+}
+
+bool ChatRequest::decode(const QByteArray &json, ChatRequest &request)
+{
+    const char *data = json.constData();
+    JsonScanner scanner(data, json.size());
+
+    ChatRequest result;
+    result.m_json = json;
+
+    if (!scanner.consume('{')) {
+        return false;
+    }
+
+    if (!scanner.consume('}')) {
+        unsigned seenFields = 0;
+
+        do {
+            int keyBegin = 0;
+            int keyLength = 0;
+            bool keyEscaped = false;
+
+            if (!scanner.scanString(keyBegin, keyLength, keyEscaped) || keyEscaped || !scanner.consume(':')) {
+                return false;
+            }
+
+            const int field = fieldForKey(data + keyBegin, keyLength);
+            if (field < 0) {
+                if (!scanner.skipValue()) {
+                    return false;
+                }
+                continue;
+            }
+
+            // Duplicate keys are resolved by QJsonDocument, don't guess its semantics here.
+            if (seenFields & (1u << field)) {
+                return false;
+            }
+            seenFields |= 1u << field;
+
+            scanner.skipWhitespace();
+
+            if (field < Token) {
+                int begin = 0;
+                int length = 0;
+                bool integer = false;
+
+                if (!scanner.scanNumber(begin, length, integer) || !integer) {
+                    return false;
+                }
+
+                const bool negative = data[begin] == '-';
+                const int digitsBegin = negative ? begin + 1 : begin;
+                if (begin + length - digitsBegin > maxIntegerDigits) {
+                    return false;
+                }
+
+                int value = 0;
+                for (int i = digitsBegin; i < begin + length; ++i) {
+                    value = value * 10 + (data[i] - '0');
+                }
+
+                result.m_integers[field] = negative ? -value : value;
+                result.m_integerFields |= 1u << field;
+            } else {
+                Span &span = result.m_spans[field];
+                if (!scanner.scanString(span.begin, span.length, span.escaped)) {
+                    return false;
+                }
+            }
+        } while (scanner.consume(','));
+
+        if (!scanner.consume('}')) {
+            return false;
+        }
+    }
+
+    scanner.skipWhitespace();
+    if (!scanner.atEnd()) {
+        return false;
+    }
+
+    result.m_streamDecoded = true;
+    request = result;
+
+    return true;
+}
+
+bool ChatRequest::isStreamDecoded() const
+{
+    return m_streamDecoded;
+}
+
+int ChatRequest::action() const
+{
+    return m_integers[Action];
+}
+
+int ChatRequest::limit() const
+{
+    return m_integers[Limit];
+}
+
+int ChatRequest::lastSeq() const
+{
+    return m_integers[LastSeq];
+}
+
+int ChatRequest::size() const
+{
+    return m_integers[Size];
+}
+
+int ChatRequest::credit() const
+{
+    return m_integers[Credit];
+}
+
+QString ChatRequest::value(Field field) const
+{
+    if (field < Token || field >= FieldCount) {
+        return QString();
+    }
+
+    if (m_streamDecoded) {
+        return decodeSpan(m_spans[field]);
+    }
+
+    return m_values[field];
+}
+
+bool ChatRequest::hasValue(Field field) const
+{
+    if (field < Token) {
+        return field >= Action && (m_integerFields & (1u << field));
+    }
+
+    if (field >= FieldCount) {
+        return false;
+    }
+
+    if (m_streamDecoded) {
+        return m_spans[field].length > 0;
+    }
+
+    return !m_values[field].isEmpty();
+}
+
+QString ChatRequest::token() const
+{
+    return value(Token);
+}
+
+QString ChatRequest::target() const
+{
+    return value(Target);
+}
+
+QString ChatRequest::message() const
+{
+    return value(Message);
+}
+
+QString ChatRequest::name() const
+{
+    return value(Name);
+}
+
+QString ChatRequest::password() const
+{
+    return value(Password);
+}
+
+QString ChatRequest::pubKey() const
+{
+    return value(PubKey);
+}
+
+QString ChatRequest::cursor() const
+{
+    return value(Cursor);
+}
+
+QString ChatRequest::decodeSpan(const Span &span) const
+{
+    if (span.begin < 0 || span.length == 0) {
+        return QString();
+    }
+
+    const char *data = m_json.constData() + span.begin;
+    if (!span.escaped) {
+        return QString::fromUtf8(data, span.length);
+    }
+
+    QString result;
+    result.reserve(span.length);
+
+    int runBegin = 0;
+    int pos = 0;
+    while (pos < span.length) {
+        if (data[pos] != '\\') {
+            ++pos;
+            continue;
+        }
+
+        result += QString::fromUtf8(data + runBegin, pos - runBegin);
+
+        const char e = data[pos + 1];
+        switch (e) {
+        case 'b': result += QChar('\b'); break;
+        case 'f': result += QChar('\f'); break;
+        case 'n': result += QChar('\n'); break;
+        case 'r': result += QChar('\r'); break;
+        case 't': result += QChar('\t'); break;
+        case 'u': {
+            ushort unit = 0;
+            for (int i = 2; i < 6; ++i) {
+                unit = static_cast<ushort>((unit << 4) | hexValue(data[pos + i]));
+            }
+            result += QChar(unit);
+            pos += 4;
+            break;
+        }
+        default:
+            result += QLatin1Char(e);
+            break;
+        }
+
+        pos += 2;
+        runBegin = pos;
+    }
+
+    result += QString::fromUtf8(data + runBegin, span.length - runBegin);
+
+    return result;
+}
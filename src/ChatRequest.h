@@ -0,0 +1,80 @@
+#ifndef CHATREQUEST_H
+#define CHATREQUEST_H
+
+#include <QByteArray>
+#include <QString>
+
+class QJsonObject;
+
+// Decoded WebSocket request. The fixed request schema is read in a single pass over the
+// UTF-8 frame: known fields are remembered as byte ranges and only turned into QStrings
+// when accessed, unknown fields are skipped. Anything the fast path doesn't fully
+// understand (malformed JSON, unexpected value types, duplicate keys) goes through
+// QJsonDocument instead, so both paths yield the same values.
+class ChatRequest
+{
+public:
+    enum Field {
+        // Integer fields
+        Action,
+        Limit,
+        LastSeq,
+        Size,
+        Credit,
+
+        // String fields
+        Token,
+        Target,
+        Message,
+        Name,
+        Password,
+        PubKey,
+        Cursor,
+        FieldCount
+    };
+
+    static ChatRequest fromJson(const QByteArray &json);
+    static ChatRequest fromJsonObject(const QJsonObject &object);
+
+    // Fast path only, returns false when the input has to be handled by the generic parser.
+    static bool decode(const QByteArray &json, ChatRequest &request);
+
+    bool isStreamDecoded() const;
+
+    int action() const;
+    int limit() const;
+    int lastSeq() const;
+    int size() const;
+    int credit() const;
+
+    QString value(Field field) const;
+    bool hasValue(Field field) const;
+
+    QString token() const;
+    QString target() const;
+    QString message() const;
+    QString name() const;
+    QString password() const;
+    QString pubKey() const;
+    QString cursor() const;
+
+private:
+    struct Span {
+        int begin = -1;
+        int length = 0;
+        bool escaped = false;
+    };
+
+    QString decodeSpan(const Span &span) const;
+
+private:
+    QByteArray m_json;
+    Span m_spans[FieldCount];
+    QString m_values[FieldCount];
+
+    int m_integers[Token] = {};
+    unsigned m_integerFields = 0;
+    bool m_streamDecoded = false;
+};
+
+#endif // CHATREQUEST_H
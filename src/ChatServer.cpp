@@ -1,9 +1,23 @@
 #include "ChatServer.h"
+#include "ChatRequest.h"
+#include "ConnectionRegistry.h"
+#include "ContactManager.h"
+#include "FileTransferManager.h"
 #include "HttpServer.h"
 #include "HttpsServer.h"
+#include "Logger.h"
+#include "ReplayRing.h"
+#include "Room.h"
+#include "RoomManager.h"
+#include "SessionHandoff.h"
+#include "SessionStore.h"
+#include "Tracer.h"
 #include "User.h"
 #include "UserManager.h"
 
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QTimer>
 #include <QWebSocketServer>
 #include <QWebSocket>
 #include <QJsonDocument>
@@ -13,10 +27,189 @@
 #include <QFile>
 #include <QSslKey>
 
+namespace {
+
+constexpr unsigned fieldBit(ChatRequest::Field field)
+{
+    return 1u << field;
+}
+
+template<int N>
+constexpr bool isIndexedByAction(const ChatServer::RequestDescriptor (&table)[N])
+{
+    for (int i = 0; i < N; ++i) {
+        if (table[i].action != i) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+const int drainTimeoutMs = 5000;
+// The new process waits for the session table, so settling must stay well below its 5 s handoff timeout.
+const int drainQuietMs = 200;
+const int drainSettleTimeoutMs = 2000;
+const int drainPollMs = 50;
+const int maxPublicKeysPerRequest = 256;
+const int defaultDirectoryPageSize = 50;
+const int maxDirectoryPageSize = 200;
+const int maxContactsPerRequest = 256;
+const int maxContactsPerUser = 1000;
+const int maxFileSize = 1024 * 1024 * 1024;
+const int maxOutgoingTransfers = 4;
+
+// A file chunk with its header, text requests stay far below it.
+const quint64 maxIncomingMessageSize = FileTransferManager::headerSize + FileTransferManager::chunkSize;
+
+}
+
+constexpr ChatServer::RequestDescriptor ChatServer::s_requestTable[HttpServer::RequestCount] = {
+    { HttpServer::LoginRequest, "LoginRequest",
+      fieldBit(ChatRequest::Name) | fieldBit(ChatRequest::Password),
+      false, HttpServer::LoginEvent, &ChatServer::handleLoginRequest },
+    { HttpServer::RegisterRequest, "RegisterRequest",
+      fieldBit(ChatRequest::Name) | fieldBit(ChatRequest::Password),
+      false, HttpServer::LoginEvent, &ChatServer::handleRegisterRequest },
+    { HttpServer::LogoutRequest, "LogoutRequest",
+      fieldBit(ChatRequest::Token),
+      true, -1, &ChatServer::handleLogoutRequest },
+    { HttpServer::MessageRequest, "MessageRequest",
+      fieldBit(ChatRequest::Token) | fieldBit(ChatRequest::Target),
+      true, -1, &ChatServer::handleMessageRequest },
+    { HttpServer::AuthorizeRequest, "AuthorizeRequest",
+      fieldBit(ChatRequest::Token),
+      true, HttpServer::InvalidUserEvent, &ChatServer::handleAuthorizeRequest },
+    { HttpServer::CreateRoomRequest, "CreateRoomRequest",
+      fieldBit(ChatRequest::Token) | fieldBit(ChatRequest::Name),
+      true, HttpServer::RoomEvent, &ChatServer::handleCreateRoomRequest },
+    { HttpServer::JoinRoomRequest, "JoinRoomRequest",
+      fieldBit(ChatRequest::Token) | fieldBit(ChatRequest::Target),
+      true, HttpServer::RoomEvent, &ChatServer::handleJoinRoomRequest },
+    { HttpServer::LeaveRoomRequest, "LeaveRoomRequest",
+      fieldBit(ChatRequest::Token) | fieldBit(ChatRequest::Target),
+      true, HttpServer::RoomEvent, &ChatServer::handleLeaveRoomRequest },
+    { HttpServer::RoomMessageRequest, "RoomMessageRequest",
+      fieldBit(ChatRequest::Token) | fieldBit(ChatRequest::Target),
+      true, -1, &ChatServer::handleRoomMessageRequest },
+    { HttpServer::PublicKeysRequest, "PublicKeysRequest",
+      fieldBit(ChatRequest::Token) | fieldBit(ChatRequest::Target),
+      true, HttpServer::PublicKeysEvent, &ChatServer::handlePublicKeysRequest },
+    { HttpServer::DirectoryRequest, "DirectoryRequest",
+      fieldBit(ChatRequest::Token),
+      true, HttpServer::DirectoryEvent, &ChatServer::handleDirectoryRequest },
+    { HttpServer::SubscribePresenceRequest, "SubscribePresenceRequest",
+      fieldBit(ChatRequest::Token) | fieldBit(ChatRequest::Target),
+      true, HttpServer::PresenceEvent, &ChatServer::handleSubscribePresenceRequest },
+    { HttpServer::UnsubscribePresenceRequest, "UnsubscribePresenceRequest",
+      fieldBit(ChatRequest::Token) | fieldBit(ChatRequest::Target),
+      true, HttpServer::PresenceEvent, &ChatServer::handleUnsubscribePresenceRequest },
+    { HttpServer::FileOfferRequest, "FileOfferRequest",
+      fieldBit(ChatRequest::Token) | fieldBit(ChatRequest::Target) | fieldBit(ChatRequest::Name) | fieldBit(ChatRequest::Size),
+      true, HttpServer::FileTransferEvent, &ChatServer::handleFileOfferRequest },
+    { HttpServer::FileAcceptRequest, "FileAcceptRequest",
+      fieldBit(ChatRequest::Token) | fieldBit(ChatRequest::Target) | fieldBit(ChatRequest::Credit),
+      true, HttpServer::FileTransferEvent, &ChatServer::handleFileAcceptRequest },
+    { HttpServer::FileCreditRequest, "FileCreditRequest",
+      fieldBit(ChatRequest::Token) | fieldBit(ChatRequest::Target) | fieldBit(ChatRequest::Credit),
+      true, HttpServer::FileTransferEvent, &ChatServer::handleFileCreditRequest },
+    { HttpServer::FileCancelRequest, "FileCancelRequest",
+      fieldBit(ChatRequest::Token) | fieldBit(ChatRequest::Target),
+      true, HttpServer::FileTransferEvent, &ChatServer::handleFileCancelRequest },
+};
+
 ChatServer::ChatServer(QObject *parent)
     : QObject(parent)
     , m_userManager(new UserManager(this))
+    , m_roomManager(new RoomManager(this))
+    , m_sessionHandoff(new SessionHandoff(this))
+    , m_sessionStore(new SessionStore(m_userManager, this))
+    , m_connections(new ConnectionRegistry(this))
+    , m_contactManager(new ContactManager(this))
+    , m_fileTransfers(new FileTransferManager(this))
+{
+    connect(m_sessionHandoff, &SessionHandoff::takeOverStarted, this, &ChatServer::drain);
+    connect(m_connections, &ConnectionRegistry::connectionClosed, this, [this](quint64 id) {
+        m_capture.recordClose(id);
+    });
+    connect(m_userManager, &UserManager::sessionChanged, m_sessionStore, &SessionStore::journal);
+    connect(m_userManager, &UserManager::activityChanged, m_sessionStore, &SessionStore::journalActivity);
+    connect(m_userManager, &UserManager::userDeauthorized, this, &ChatServer::leaveRooms);
+    connect(m_fileTransfers, &FileTransferManager::creditReleased, this, [this](FileTransferManager::Transfer *transfer, int released) {
+        QJsonObject credit;
+        credit["credit"] = released;
+        sendTransferEvent(transfer->senderSocket, transfer->id, QStringLiteral("credit"), credit);
+    });
+}
+
+void ChatServer::setUpgradeSocket(const QString &path)
+{
+    m_upgradeSocket = path;
+}
+
+void ChatServer::setHttpConnectionLimits(const HttpServer::ConnectionLimits &limits)
+{
+    m_httpConnectionLimits = limits;
+}
+
+bool ChatServer::setCapture(const QString &path, TrafficCapture::Redaction redaction)
+{
+    return m_capture.open(path, redaction);
+}
+
+void ChatServer::setPresenceMode(PresenceMode mode)
+{
+    m_presenceMode = mode;
+}
+
+ChatServer::PresenceMode ChatServer::presenceModeFromString(const QString &name, bool *ok)
 {
+    if (ok) {
+        *ok = true;
+    }
+
+    if (name == QLatin1String("broadcast")) {
+        return BroadcastPresence;
+    } else if (name == QLatin1String("directory")) {
+        return DirectoryPresence;
+    } else if (name == QLatin1String("contacts")) {
+        return ContactPresence;
+    }
+
+    if (ok) {
+        *ok = false;
+    }
+
+    return BroadcastPresence;
+}
+
+quint16 ChatServer::serverPort() const
+{
+    return m_webSocketServer ? m_webSocketServer->serverPort() : 0;
+}
+
+void ChatServer::setHttp2Enabled(bool enabled)
+{
+    m_http2Enabled = enabled;
+}
+
+void ChatServer::setReplayBufferSize(int events)
+{
+    ReplayRing::setCapacity(events);
+}
+
+bool ChatServer::setSessionTokens(const QString &keyFile, int lifetimeSeconds)
+{
+    m_userManager->setTokenLifetime(lifetimeSeconds);
+
+    return m_userManager->setTokenKeyFile(keyFile);
+}
+
+void ChatServer::setSessionSnapshot(const QString &path, int intervalSeconds, bool journal)
+{
+    m_sessionStore->setPath(path);
+    m_sessionStore->setSnapshotInterval(intervalSeconds);
+    m_sessionStore->setJournalEnabled(journal);
 }
 
 void ChatServer::setupSSL(const QString &sslCertificate, const QString &sslPrivateKey)
@@ -35,27 +228,31 @@ void ChatServer::setupSSL(const QString &sslCertificate, const QString &sslPriva
 
             privateKeyFile.close();
 
-            qDebug() << "Cert file valid:" << !certificate.isNull();
-            qDebug() << "Private key valid:" << !privateKey.isNull();
+            qCDebug(lcTls) << "Cert file valid:" << !certificate.isNull();
+            qCDebug(lcTls) << "Private key valid:" << !privateKey.isNull();
         } else {
-            qWarning() << "Couldn't load the SSH certificate file on path" << sslCertificate;
-            qWarning() << "Reason:" << privateKeyFile.errorString();
+            qCWarning(lcTls) << "Couldn't load the SSH certificate file on path" << sslCertificate;
+            qCWarning(lcTls) << "Reason:" << privateKeyFile.errorString();
         }
 
         certificateFile.close();
     } else {
-        qWarning() << "Couldn't load the SSH certificate file on path" << sslCertificate;
-        qWarning() << "Reason:" << certificateFile.errorString();
+        qCWarning(lcTls) << "Couldn't load the SSH certificate file on path" << sslCertificate;
+        qCWarning(lcTls) << "Reason:" << certificateFile.errorString();
     }
 }
 
 void ChatServer::start(const QString &ip, int httpPort, int httpsPort, quint16 port, bool disableHttps, bool disableWss)
 {
-    qDebug() << "Initiating chat server on port" << port;
+    qCDebug(lcServer) << "Initiating chat server on port" << port;
+
+    if (!m_upgradeSocket.isEmpty() && m_sessionHandoff->takeOver(m_upgradeSocket)) {
+        qCDebug(lcServer) << "Continuing from a previous process, listening sockets are inherited";
+    }
 
     if (!m_sslConfiguration.isNull() && !disableWss) {
             m_webSocketServer = new QWebSocketServer(QStringLiteral("Chat Server"), QWebSocketServer::SecureMode, this);
-            qDebug() << "SSL configuration loaded, running on secure connection";
+            qCDebug(lcTls) << "SSL configuration loaded, running on secure connection";
 
             m_sslConfiguration.setPeerVerifyMode(QSslSocket::VerifyNone);
             m_sslConfiguration.setProtocol(QSsl::TlsV1SslV3);
@@ -64,178 +261,801 @@ void ChatServer::start(const QString &ip, int httpPort, int httpsPort, quint16 p
 
             connect(m_webSocketServer, &QWebSocketServer::sslErrors, this, [this](const QList<QSslError> &errors) {
                 for (const auto &error : errors) {
-                    qWarning() << error;
+                    qCWarning(lcTls) << error;
                 }
             });
     } else {
         m_webSocketServer = new QWebSocketServer(QStringLiteral("Chat Server"), QWebSocketServer::NonSecureMode, this);
     }
 
+    // QWebSocket holds a whole message before handing it over, larger ones close the connection.
+    m_webSocketServer->setMaxAllowedIncomingMessageSize(maxIncomingMessageSize);
+    m_webSocketServer->setMaxAllowedIncomingFrameSize(maxIncomingMessageSize);
+
     connect(m_webSocketServer, &QWebSocketServer::newConnection, this, &ChatServer::onNewConnection);
-    if (m_webSocketServer->listen(QHostAddress::Any, port)) {
-        qDebug() << "Chat server started, listening on" << ip << ":" << m_webSocketServer->serverPort();
+    const qintptr chatDescriptor = m_sessionHandoff->inheritedDescriptor(SessionHandoff::ChatListener);
+    if (chatDescriptor >= 0 ? m_webSocketServer->setNativeDescriptor(chatDescriptor)
+                            : m_webSocketServer->listen(QHostAddress::Any, port)) {
+        qCDebug(lcServer) << "Chat server started, listening on" << ip << ":" << m_webSocketServer->serverPort();
 
         m_httpServer = new HttpServer(ip, m_webSocketServer->serverPort(), this);
 
         if (!m_sslConfiguration.isNull() && !disableHttps) {
             m_httpsServer = new HttpsServer(ip, m_webSocketServer->serverPort(), m_sslConfiguration, this);
+            m_httpsServer->setHttp2Enabled(m_http2Enabled);
 
-            if (m_httpsServer->listen(QHostAddress::Any, httpsPort)) {
-                qDebug() << "HTTPS server started, listening on" << ip << ":" << m_httpsServer->serverPort();
+            if (listenOrInherit(m_httpsServer, SessionHandoff::HttpsListener, httpsPort)) {
+                qCDebug(lcServer) << "HTTPS server started, listening on" << ip << ":" << m_httpsServer->serverPort();
             } else {
-                qCritical() << "Couldn't start HTTPS server on port" << httpsPort;
+                qCCritical(lcServer) << "Couldn't start HTTPS server on port" << httpsPort;
                 throw std::runtime_error(m_httpServer->errorString().toStdString());
             }
 
             m_httpServer->setRedirectTo("https://" + ip);
         } else {
-            qDebug() << "http" << m_sslConfiguration.isNull() << disableHttps;
+            qCDebug(lcServer) << "http" << m_sslConfiguration.isNull() << disableHttps;
         }
 
-        if (m_httpServer->listen(QHostAddress::Any, httpPort)) {
-            qDebug() << "HTTP server started, listening on" << ip << ":" << m_httpServer->serverPort();
+        if (listenOrInherit(m_httpServer, SessionHandoff::HttpListener, httpPort)) {
+            qCDebug(lcServer) << "HTTP server started, listening on" << ip << ":" << m_httpServer->serverPort();
         } else {
-            qCritical() << "Couldn't start HTTP server on port" << httpPort;
+            qCCritical(lcServer) << "Couldn't start HTTP server on port" << httpPort;
             throw std::runtime_error(m_httpServer->errorString().toStdString());
         }
     } else {
-        qCritical() << "Couldn't start chat server on port" << port;
+        qCCritical(lcServer) << "Couldn't start chat server on port" << port;
         throw std::runtime_error(m_webSocketServer->errorString().toStdString());
     }
 
     m_userManager->loadUsers();
-    connect(m_userManager, &UserManager::activeUsersChanged, this, &ChatServer::sendUserListChange);
+    m_contactManager->loadContacts();
+    if (m_sessionStore->load()) {
+        connect(qApp, &QCoreApplication::aboutToQuit, m_sessionStore, &SessionStore::snapshot);
+    }
+    // Sessions handed over by a running process are newer than anything on disk.
+    m_userManager->importSessions(m_sessionHandoff->inheritedSessions());
+    m_sessionStore->journalRecords(m_sessionHandoff->inheritedSessions());
+    if (m_presenceMode == BroadcastPresence) {
+        connect(m_userManager, &UserManager::activeUsersChanged, this, &ChatServer::sendUserListChange);
+    } else {
+        connect(m_userManager, &UserManager::presenceChanged, this, &ChatServer::queuePresenceChange);
+    }
+
+    if (!m_upgradeSocket.isEmpty()) {
+        m_sessionHandoff->setDescriptor(SessionHandoff::ChatListener, m_webSocketServer->nativeDescriptor());
+        m_sessionHandoff->setDescriptor(SessionHandoff::HttpListener, m_httpServer->socketDescriptor());
+        if (m_httpsServer) {
+            m_sessionHandoff->setDescriptor(SessionHandoff::HttpsListener, m_httpsServer->socketDescriptor());
+        }
+
+        m_sessionHandoff->listen(m_upgradeSocket, m_userManager);
+    }
+}
+
+bool ChatServer::listenOrInherit(HttpServer *server, SessionHandoff::Listener listener, int port)
+{
+    server->setConnectionLimits(m_httpConnectionLimits);
+
+    const qintptr descriptor = m_sessionHandoff->inheritedDescriptor(listener);
+    const bool listening = descriptor >= 0 ? server->setSocketDescriptor(descriptor)
+                                           : server->listen(QHostAddress::Any, port);
+
+    if (listening) {
+        server->applyListenBacklog();
+    }
+
+    return listening;
+}
+
+void ChatServer::drain()
+{
+    qCDebug(lcServer) << "Listening sockets handed over to the new process, draining connections";
+
+    // The new process holds its own duplicates of the listening sockets, closing ours doesn't
+    // stop the ports from accepting.
+    m_webSocketServer->close();
+    m_httpServer->close();
+    if (m_httpsServer) {
+        m_httpsServer->close();
+    }
+
+    // Requests already on their way are still served, the session table is only handed over
+    // once the connections went quiet so that it includes what they changed.
+    m_drainStarted.start();
+    m_drainTimer = new QTimer(this);
+    connect(m_drainTimer, &QTimer::timeout, this, &ChatServer::finishDrain);
+    m_drainTimer->start(drainPollMs);
+}
+
+void ChatServer::finishDrain()
+{
+    const qint64 idleMs = QDateTime::currentMSecsSinceEpoch() - m_connections->lastActivity();
+    if (idleMs < drainQuietMs && m_drainStarted.elapsed() < drainSettleTimeoutMs) {
+        return;
+    }
+
+    m_drainTimer->stop();
+    m_handedOver = true;
+
+    disconnect(m_userManager, &UserManager::activeUsersChanged, this, &ChatServer::sendUserListChange);
+    disconnect(m_userManager, &UserManager::presenceChanged, this, &ChatServer::queuePresenceChange);
+
+    m_sessionHandoff->completeHandoff();
+
+    // The new process owns the session snapshot from now on.
+    m_sessionStore->close();
+
+    qCDebug(lcServer) << "Sessions handed over, closing connections" << LogField("drainMs", m_drainStarted.elapsed())
+                      << LogField("connections", m_connections->count());
+
+    // Responses still queued go out before the close frame. Tokens are known to the new
+    // process, clients reconnect and authorize there.
+    m_connections->closeAll(QWebSocketProtocol::CloseCodeGoingAway, QStringLiteral("Server is restarting"));
+
+    connect(m_connections, &ConnectionRegistry::connectionClosed, qApp, [this]() {
+        if (m_connections->count() == 0) {
+            QCoreApplication::quit();
+        }
+    });
+    QTimer::singleShot(drainTimeoutMs, qApp, &QCoreApplication::quit);
 }
 
 void ChatServer::onNewConnection() {
     auto socket = m_webSocketServer->nextPendingConnection();
+    if (!socket) {
+        return;
+    }
+
+    const ConnectionRegistry::Connection *connection = m_connections->open(socket);
+    m_capture.recordOpen(connection->id);
 
     connect(socket, &QWebSocket::textMessageReceived, this, [this, socket](const QString &message) {
         handleMessage(message, socket);
     });
+    connect(socket, &QWebSocket::binaryMessageReceived, this, [this, socket](const QByteArray &frame) {
+        handleBinaryMessage(frame, socket);
+    });
+    connect(socket, &QWebSocket::disconnected, this, [this, socket]() {
+        cancelTransfersOf(socket);
+    });
 }
 
 void ChatServer::handleMessage(const QString &message, QWebSocket* socket)
 {
-    const auto request = QJsonDocument::fromJson(message.toUtf8()).object();
-    const auto action = request["action"].toInt();
-    QJsonObject response;
-    response["valid"] = true;
+    TraceSpan messageSpan("handleMessage", "chat");
+
+    // Sessions are with the new process already, the client retries there after reconnecting.
+    if (m_handedOver) {
+        return;
+    }
+
+    // QWebSocket only hands text frames over as a QString it has already decoded and validated,
+    // neither textMessageReceived nor textFrameReceived give the bytes. Converting back is a
+    // vectorized copy for the mostly ASCII requests, tests/bench_chatrequest sets it against the decode.
+    const QByteArray payload = message.toUtf8();
+
+    ConnectionRegistry::Connection *connection = m_connections->find(socket);
+    if (connection) {
+        m_connections->touch(connection);
 
-    if (!m_httpServer->isValueInEnumRange(action, "Requests")) {
+        m_capture.recordFrame(connection->id, payload);
+    }
+
+    ChatRequest request;
+    {
+        TraceSpan parseSpan("parseRequest", "chat");
+        request = ChatRequest::fromJson(payload);
+    }
+
+    const RequestDescriptor *descriptor = requestDescriptor(request.action());
+    if (!descriptor) {
+        QJsonObject response;
         response["valid"] = false;
-        socket->sendTextMessage(QString::fromUtf8(QJsonDocument(response).toJson(QJsonDocument::Compact)));
+        sendJson(socket, response);
+
         return;
     }
 
-    HttpServer::Requests requestType = static_cast<HttpServer::Requests>(action);
+    for (int field = ChatRequest::Token; field < ChatRequest::FieldCount; ++field) {
+        if ((descriptor->requiredFields & (1u << field)) && !request.hasValue(static_cast<ChatRequest::Field>(field))) {
+            sendError(socket, descriptor->errorEvent, "Please fill all fields.");
 
-    switch (requestType) {
+            return;
+        }
+    }
 
-    case HttpServer::LoginRequest:
-    case HttpServer::RegisterRequest: {
-        const auto name = request["name"].toString();
-        const auto password = request["password"].toString();
-        response["event"] = HttpServer::Responses::LoginEvent;
+    User* user = nullptr;
+    if (descriptor->requiresAuth) {
+        TraceSpan authSpan("authenticate", "chat");
 
-        if (name.isEmpty() || password.isEmpty()) {
-            response["valid"] = false;
-            response["error"] = "Please fill all fields.";
-            socket->sendTextMessage(QString::fromUtf8(QJsonDocument(response).toJson()));
+        user = m_userManager->findUserByToken(request.token());
+        if (!user) {
+            sendError(socket, descriptor->errorEvent, "Invalid token.");
 
             return;
         }
 
-        User* user = nullptr;
-        if (requestType == HttpServer::RegisterRequest) {
-            if (!m_userManager->saveUser(name, password)) {
-                response["valid"] = false;
-                response["error"] = "Username already exists.";
-                socket->sendTextMessage(QString::fromUtf8(QJsonDocument(response).toJson()));
+        m_userManager->authorizeUser(user);
+    }
 
-                return;
-            } else {
-                user = m_userManager->users().last();
-            }
-        } else {
-            user = m_userManager->authenticateUser(name, password);
+    TraceSpan handlerSpan(descriptor->name, "handler");
+    (this->*descriptor->handler)(request, socket, user);
+}
+
+void ChatServer::handleBinaryMessage(const QByteArray &frame, QWebSocket *socket)
+{
+    TraceSpan span("handleBinaryMessage", "file");
+
+    if (m_handedOver) {
+        return;
+    }
+
+    ConnectionRegistry::Connection *connection = m_connections->find(socket);
+    if (connection) {
+        m_connections->touch(connection);
+
+        m_capture.recordBinaryFrame(connection->id, frame.size());
+    }
+
+    FileTransferManager::Transfer *transfer = nullptr;
+    QString error;
+
+    switch (m_fileTransfers->forwardChunk(socket, frame, &transfer, &error)) {
+    case FileTransferManager::ChunkForwarded:
+        break;
+    case FileTransferManager::TransferCompleted:
+        sendTransferEvent(transfer->senderSocket, transfer->id, QStringLiteral("completed"));
+        sendTransferEvent(transfer->receiverSocket, transfer->id, QStringLiteral("completed"));
+        m_fileTransfers->remove(transfer);
+        break;
+    case FileTransferManager::UnknownTransfer:
+        sendError(socket, HttpServer::Responses::FileTransferEvent, error);
+        break;
+    case FileTransferManager::ChunkRejected:
+        cancelTransfer(transfer, error);
+        break;
+    }
+}
+
+const ChatServer::RequestDescriptor *ChatServer::requestDescriptor(int action)
+{
+    static_assert(isIndexedByAction(s_requestTable), "Request table entries must be ordered by action id");
+
+    if (action < 0 || action >= HttpServer::RequestCount) {
+        return nullptr;
+    }
+
+    return &s_requestTable[action];
+}
+
+void ChatServer::handleLoginRequest(const ChatRequest &request, QWebSocket *socket, User *)
+{
+    User* user = m_userManager->authenticateUser(request.name(), request.password());
+    if (!user) {
+        sendError(socket, HttpServer::Responses::LoginEvent, "User or password is invalid.");
+
+        return;
+    }
+
+    loginUser(user, request, socket);
+}
+
+void ChatServer::handleRegisterRequest(const ChatRequest &request, QWebSocket *socket, User *)
+{
+    if (!m_userManager->saveUser(request.name(), request.password())) {
+        sendError(socket, HttpServer::Responses::LoginEvent, "Username already exists.");
+
+        return;
+    }
+
+    loginUser(m_userManager->users().last(), request, socket);
+}
+
+void ChatServer::loginUser(User *user, const ChatRequest &request, QWebSocket *socket)
+{
+    // One session per user, the previous tokens stop working everywhere, including ones this
+    // instance never saw.
+    if (user->socket()) {
+        user->socket()->close();
+    }
+
+    user->setPublicKey(request.pubKey());
+    m_userManager->authorizeUser(user, socket);
+    m_userManager->issueToken(user);
+
+    QJsonObject response;
+    response["valid"] = true;
+    response["event"] = HttpServer::Responses::LoginEvent;
+    response["token"] = user->token();
+    response["username"] = user->name();
+    response["seq"] = static_cast<qint64>(user->replayRing().lastSeq());
+    // Tells the client to page through the directory, nobody sends it the whole list.
+    if (m_presenceMode == DirectoryPresence) {
+        response["directory"] = true;
+    }
+
+    sendJson(socket, response);
+
+    if (m_presenceMode == ContactPresence) {
+        sendPresenceSnapshot(user);
+    } else if (m_presenceMode == BroadcastPresence) {
+        sendUserListChange();
+    }
+}
+
+void ChatServer::handleLogoutRequest(const ChatRequest &, QWebSocket *, User *user)
+{
+    m_userManager->revokeTokens(user);
+    m_userManager->deauthorizeUser(user);
+}
+
+void ChatServer::handleMessageRequest(const ChatRequest &request, QWebSocket *, User *user)
+{
+    // A recipient whose connection dropped keeps its session, the message waits in its replay ring.
+    User* targetUser = m_userManager->findUserById(request.target());
+    if (targetUser && !targetUser->token().isEmpty()) {
+        QJsonObject response;
+        response["valid"] = true;
+        response["event"] = HttpServer::Responses::MessageEvent;
+        response["sender"] = user->id();
+        response["message"] = request.message();
+
+        deliver(targetUser, encode(response));
+    }
+}
+
+void ChatServer::handleAuthorizeRequest(const ChatRequest &request, QWebSocket *socket, User *user)
+{
+    ReplayRing &replayRing = user->replayRing();
+    const bool resumed = request.hasValue(ChatRequest::LastSeq) && request.lastSeq() >= 0
+            && replayRing.covers(static_cast<quint64>(request.lastSeq()));
+
+    m_userManager->authorizeUser(user, socket, request.token());
+
+    QJsonObject response;
+    response["valid"] = true;
+    response["event"] = HttpServer::Responses::AuthorizationEvent;
+    response["seq"] = static_cast<qint64>(replayRing.lastSeq());
+    response["resumed"] = resumed;
+    if (m_presenceMode == DirectoryPresence) {
+        response["directory"] = true;
+    }
+
+    sendJson(socket, response);
+
+    if (resumed) {
+        for (const QString &frame : replayRing.since(static_cast<quint64>(request.lastSeq()))) {
+            socket->sendTextMessage(frame);
         }
+    }
 
-        if (user) {
-            if (!user->token().isEmpty()) {
-                user->setToken("");
-                if (user->socket()) {
-                    user->socket()->close();
-                }
-            }
+    // Presence events aren't sequenced, a fresh snapshot (or directory listing) covers whatever the gap missed.
+    if (m_presenceMode == ContactPresence) {
+        sendPresenceSnapshot(user);
+    } else if (m_presenceMode == BroadcastPresence && !resumed) {
+        // When resuming, the user list already went out when the socket was attached.
+        sendUserListChange();
+    }
+}
+
+void ChatServer::handleCreateRoomRequest(const ChatRequest &request, QWebSocket *socket, User *user)
+{
+    Room* room = m_roomManager->createRoom(request.name(), user);
+    if (!room) {
+        sendError(socket, HttpServer::Responses::RoomEvent, "Room name is already taken.");
+
+        return;
+    }
 
-            m_userManager->authorizeUser(user, socket);
-            user->setPublicKey(request["pubKey"].toString());
+    QJsonObject response;
+    response["valid"] = true;
+    response["event"] = HttpServer::Responses::RoomEvent;
+    response["room"] = getRoomAsJsonObject(room);
 
-            response["token"] = user->token();
-            response["username"] = user->name();
+    sendJson(socket, response);
+}
 
-            sendUserListChange();
-            response["users"] = getUserListAsJsonObject(m_userManager->activeUsers());
+void ChatServer::handleJoinRoomRequest(const ChatRequest &request, QWebSocket *socket, User *user)
+{
+    Room* room = m_roomManager->findRoomById(request.target());
+    if (!room) {
+        sendError(socket, HttpServer::Responses::RoomEvent, "Room does not exist.");
 
-            socket->sendTextMessage(QString::fromUtf8(QJsonDocument(response).toJson()));
-        } else {
-            response["valid"] = false;
-            response["error"] = "User or password is invalid.";
-            socket->sendTextMessage(QString::fromUtf8(QJsonDocument(response).toJson()));
+        return;
+    }
+
+    const bool wasMember = room->isMember(user);
+    if (m_roomManager->joinRoom(room, user)) {
+        QJsonObject joinedEvent;
+        joinedEvent["valid"] = true;
+        joinedEvent["event"] = HttpServer::Responses::RoomEvent;
+        joinedEvent["room"] = room->id();
+        joinedEvent["joined"] = user->id();
+
+        sendToRoom(room, joinedEvent);
+    }
+
+    QJsonObject response;
+    response["valid"] = true;
+    response["event"] = HttpServer::Responses::RoomEvent;
+    response["room"] = getRoomAsJsonObject(room);
+
+    // A member coming back after a reconnect gets the room events it missed, newcomers don't.
+    ReplayRing &replayRing = room->replayRing();
+    const bool resumed = wasMember && request.hasValue(ChatRequest::LastSeq) && request.lastSeq() >= 0
+            && replayRing.covers(static_cast<quint64>(request.lastSeq()));
+    response["roomSeq"] = static_cast<qint64>(replayRing.lastSeq());
+    response["resumed"] = resumed;
+
+    sendJson(socket, response);
+
+    if (resumed) {
+        for (const QString &frame : replayRing.since(static_cast<quint64>(request.lastSeq()))) {
+            socket->sendTextMessage(frame);
         }
+    }
+}
 
-        break;
+void ChatServer::handleLeaveRoomRequest(const ChatRequest &request, QWebSocket *socket, User *user)
+{
+    Room* room = m_roomManager->findRoomById(request.target());
+    if (!room) {
+        sendError(socket, HttpServer::Responses::RoomEvent, "Room does not exist.");
+
+        return;
+    }
+
+    QJsonObject response;
+    response["valid"] = true;
+    response["event"] = HttpServer::Responses::RoomEvent;
+    response["room"] = room->id();
+    response["left"] = user->id();
+
+    if (m_roomManager->leaveRoom(room, user)) {
+        sendToRoom(room, response);
     }
-    case HttpServer::LogoutRequest: {
-        const auto token = request["token"].toString();
-        const auto user = m_userManager->findUserByToken(token);
-        if (user) {
-            m_userManager->deauthorizeUser(user);
+
+    sendJson(socket, response);
+}
+
+void ChatServer::leaveRooms(User *user)
+{
+    // A dropped connection keeps its rooms so the member can catch up after reconnecting, an ended
+    // session doesn't, or every post would keep walking members who are gone for good.
+    for (Room *room : m_roomManager->roomsOfUser(user)) {
+        QJsonObject event;
+        event["valid"] = true;
+        event["event"] = HttpServer::Responses::RoomEvent;
+        event["room"] = room->id();
+        event["left"] = user->id();
+
+        if (m_roomManager->leaveRoom(room, user)) {
+            sendToRoom(room, event);
         }
+    }
+}
 
-        break;
+void ChatServer::handleRoomMessageRequest(const ChatRequest &request, QWebSocket *, User *user)
+{
+    Room* room = m_roomManager->findRoomById(request.target());
+    if (room && room->isMember(user)) {
+        QJsonObject response;
+        response["valid"] = true;
+        response["event"] = HttpServer::Responses::RoomMessageEvent;
+        response["room"] = room->id();
+        response["sender"] = user->id();
+        response["message"] = request.message();
+
+        sendToRoom(room, response);
     }
+}
+
+void ChatServer::handlePublicKeysRequest(const ChatRequest &request, QWebSocket *socket, User *)
+{
+    const auto ids = request.target().split(',', Qt::SkipEmptyParts);
+    if (ids.size() > maxPublicKeysPerRequest) {
+        sendError(socket, HttpServer::Responses::PublicKeysEvent, "Too many keys requested at once.");
 
-    case HttpServer::MessageRequest: {
-        const auto token = request["token"].toString();
-        const auto user = m_userManager->findUserByToken(token);
-        if (user) {
-            m_userManager->authorizeUser(user);
-            const auto targetId = request["target"].toString();
-            const auto message = request["message"].toString();
+        return;
+    }
 
-            User* targetUser = m_userManager->findActiveUserById(targetId);
-            if (targetUser) {
-                response["event"] = HttpServer::Responses::MessageEvent;
-                response["sender"] = user->id();
-                response["message"] = message;
+    QJsonArray keyArray;
+    for (const auto &id : ids) {
+        User* keyOwner = m_userManager->findUserById(id.trimmed());
+        if (keyOwner && !keyOwner->publicKey().isEmpty()) {
+            QJsonObject keyObj;
+            keyObj["id"] = keyOwner->id();
+            keyObj["keyFingerprint"] = keyOwner->keyFingerprint();
+            keyObj["publicKey"] = keyOwner->publicKey();
 
-                targetUser->socket()->sendTextMessage(QString::fromUtf8(QJsonDocument(response).toJson()));
-            }
+            keyArray.append(keyObj);
         }
+    }
 
-        break;
+    QJsonObject response;
+    response["valid"] = true;
+    response["event"] = HttpServer::Responses::PublicKeysEvent;
+    response["keys"] = keyArray;
+
+    sendJson(socket, response);
+}
+
+void ChatServer::handleDirectoryRequest(const ChatRequest &request, QWebSocket *socket, User *)
+{
+    const int limit = request.limit() > 0 ? qMin(request.limit(), maxDirectoryPageSize) : defaultDirectoryPageSize;
+
+    QString nextCursor;
+    const auto page = m_userManager->findActiveUsersByPrefix(request.name(), request.cursor(), limit, &nextCursor);
+
+    QJsonObject response;
+    response["valid"] = true;
+    response["event"] = HttpServer::Responses::DirectoryEvent;
+    response["users"] = getUserListAsJsonObject(page);
+    if (!nextCursor.isEmpty()) {
+        response["cursor"] = nextCursor;
     }
-    case HttpServer::AuthorizeRequest:{
-        const auto token = request["token"].toString();
-        response["event"] = HttpServer::Responses::AuthorizationEvent;
-        auto user = m_userManager->findUserByToken(token);
 
-        response["valid"] = (user != nullptr);
-        if (user) {
-            m_userManager->authorizeUser(user, socket);
-        } else {
-            response["event"] = HttpServer::Responses::InvalidUserEvent;
-            socket->sendTextMessage(QString::fromUtf8(QJsonDocument(response).toJson()));
+    sendJson(socket, response);
+}
+
+void ChatServer::handleSubscribePresenceRequest(const ChatRequest &request, QWebSocket *socket, User *user)
+{
+    const auto ids = request.target().split(',', Qt::SkipEmptyParts);
+    if (ids.size() > maxContactsPerRequest
+            || m_contactManager->contacts(user->id()).size() + ids.size() > maxContactsPerUser) {
+        sendError(socket, HttpServer::Responses::PresenceEvent, "Too many contacts.");
+
+        return;
+    }
+
+    QStringList contactIds;
+    for (const auto &id : ids) {
+        if (m_userManager->findUserById(id.trimmed())) {
+            contactIds.append(id.trimmed());
         }
+    }
 
-        socket->sendTextMessage(QString::fromUtf8(QJsonDocument(response).toJson(QJsonDocument::Compact)));
+    QJsonArray presenceArray;
+    for (const auto &id : m_contactManager->addContacts(user->id(), contactIds)) {
+        presenceArray.append(getPresenceAsJsonObject(m_userManager->findUserById(id)));
+    }
 
-        sendUserListChange();
+    QJsonObject response;
+    response["valid"] = true;
+    response["event"] = HttpServer::Responses::PresenceEvent;
+    response["users"] = presenceArray;
 
-        break;
+    sendJson(socket, response);
+}
+
+void ChatServer::handleUnsubscribePresenceRequest(const ChatRequest &request, QWebSocket *socket, User *user)
+{
+    QStringList contactIds;
+    for (const auto &id : request.target().split(',', Qt::SkipEmptyParts)) {
+        contactIds.append(id.trimmed());
+    }
+
+    if (contactIds.size() > maxContactsPerRequest) {
+        sendError(socket, HttpServer::Responses::PresenceEvent, "Too many contacts.");
+
+        return;
+    }
+
+    QJsonObject response;
+    response["valid"] = true;
+    response["event"] = HttpServer::Responses::PresenceEvent;
+    response["users"] = QJsonArray();
+    response["removed"] = QJsonArray::fromStringList(m_contactManager->removeContacts(user->id(), contactIds));
+
+    sendJson(socket, response);
+}
+
+void ChatServer::handleFileOfferRequest(const ChatRequest &request, QWebSocket *socket, User *user)
+{
+    User *receiver = m_userManager->findUserById(request.target());
+    if (!receiver || !receiver->socket() || receiver == user) {
+        sendError(socket, HttpServer::Responses::FileTransferEvent, "Receiver is not available.");
+
+        return;
+    }
+
+    if (request.size() <= 0 || request.size() > maxFileSize) {
+        sendError(socket, HttpServer::Responses::FileTransferEvent, "Invalid file size.");
+
+        return;
+    }
+
+    if (m_fileTransfers->outgoingCount(socket) >= maxOutgoingTransfers) {
+        sendError(socket, HttpServer::Responses::FileTransferEvent, "Too many transfers in progress.");
+
+        return;
+    }
+
+    FileTransferManager::Transfer *transfer = m_fileTransfers->offer(user, socket, receiver, receiver->socket(),
+                                                                              request.name(), request.size());
+
+    QJsonObject offer;
+    offer["sender"] = user->id();
+    offer["name"] = transfer->name;
+    offer["size"] = transfer->size;
+    offer["chunkSize"] = FileTransferManager::chunkSize;
+    offer["maxCredit"] = FileTransferManager::maxCredit;
+    sendTransferEvent(receiver->socket(), transfer->id, QStringLiteral("offered"), offer);
+
+    // The sender learns the transfer id here and waits for credit before sending chunks.
+    QJsonObject pending;
+    pending["target"] = receiver->id();
+    pending["chunkSize"] = FileTransferManager::chunkSize;
+    sendTransferEvent(socket, transfer->id, QStringLiteral("pending"), pending);
+}
+
+void ChatServer::handleFileAcceptRequest(const ChatRequest &request, QWebSocket *socket, User *)
+{
+    FileTransferManager::Transfer *transfer = m_fileTransfers->find(request.target().toUInt());
+    if (!transfer || transfer->receiverSocket != socket || transfer->state != FileTransferManager::Offered) {
+        sendError(socket, HttpServer::Responses::FileTransferEvent, "Unknown transfer.");
+
+        return;
+    }
+
+    m_fileTransfers->accept(transfer);
+
+    QJsonObject accepted;
+    accepted["credit"] = m_fileTransfers->grantCredit(transfer, request.credit());
+    sendTransferEvent(transfer->senderSocket, transfer->id, QStringLiteral("accepted"), accepted);
+}
+
+void ChatServer::handleFileCreditRequest(const ChatRequest &request, QWebSocket *socket, User *)
+{
+    FileTransferManager::Transfer *transfer = m_fileTransfers->find(request.target().toUInt());
+    if (!transfer || transfer->receiverSocket != socket) {
+        sendError(socket, HttpServer::Responses::FileTransferEvent, "Unknown transfer.");
+
+        return;
+    }
+
+    const int granted = m_fileTransfers->grantCredit(transfer, request.credit());
+    if (granted > 0) {
+        QJsonObject credit;
+        credit["credit"] = granted;
+        sendTransferEvent(transfer->senderSocket, transfer->id, QStringLiteral("credit"), credit);
+    }
+}
+
+void ChatServer::handleFileCancelRequest(const ChatRequest &request, QWebSocket *socket, User *)
+{
+    FileTransferManager::Transfer *transfer = m_fileTransfers->find(request.target().toUInt());
+    if (!transfer || (transfer->senderSocket != socket && transfer->receiverSocket != socket)) {
+        sendError(socket, HttpServer::Responses::FileTransferEvent, "Unknown transfer.");
+
+        return;
+    }
+
+    cancelTransfer(transfer, transfer->senderSocket == socket ? QStringLiteral("Cancelled by the sender.")
+                                                      : QStringLiteral("Cancelled by the receiver."));
+}
+
+void ChatServer::sendTransferEvent(QWebSocket *socket, quint32 transfer, const QString &state, QJsonObject event)
+{
+    event["valid"] = true;
+    event["event"] = HttpServer::Responses::FileTransferEvent;
+    event["transfer"] = QString::number(transfer);
+    event["state"] = state;
+
+    sendJson(socket, event);
+}
+
+void ChatServer::cancelTransfer(FileTransferManager::Transfer *transfer, const QString &reason)
+{
+    QJsonObject cancelled;
+    cancelled["error"] = reason;
+
+    sendTransferEvent(transfer->senderSocket, transfer->id, QStringLiteral("cancelled"), cancelled);
+    sendTransferEvent(transfer->receiverSocket, transfer->id, QStringLiteral("cancelled"), cancelled);
+
+    m_fileTransfers->remove(transfer);
+}
+
+void ChatServer::cancelTransfersOf(QWebSocket *socket)
+{
+    for (FileTransferManager::Transfer *transfer : m_fileTransfers->transfersOf(socket)) {
+        cancelTransfer(transfer, QStringLiteral("Connection closed."));
     }
+}
+
+void ChatServer::sendJson(QWebSocket *socket, const QJsonObject &object)
+{
+    if (socket) {
+        socket->sendTextMessage(QString::fromUtf8(QJsonDocument(object).toJson(QJsonDocument::Compact)));
+    }
+}
+
+void ChatServer::sendError(QWebSocket *socket, int event, const QString &error)
+{
+    if (event < 0) {
+        return;
+    }
+
+    QJsonObject response;
+    response["valid"] = false;
+    response["event"] = event;
+    response["error"] = error;
+
+    sendJson(socket, response);
+}
+
+QJsonObject ChatServer::getRoomAsJsonObject(Room *room)
+{
+    QJsonObject roomObj;
+    roomObj["id"] = room->id();
+    roomObj["name"] = room->name();
+    roomObj["owner"] = room->owner() ? room->owner()->id() : QString();
+
+    QJsonArray memberArray;
+    for (const auto &member : room->members()) {
+        memberArray.append(member->id());
+    }
+    roomObj["members"] = memberArray;
+
+    return roomObj;
+}
+
+QJsonObject ChatServer::getPresenceAsJsonObject(User *user)
+{
+    QJsonObject presenceObj;
+    presenceObj["id"] = user->id();
+    presenceObj["name"] = user->name();
+    presenceObj["keyFingerprint"] = user->keyFingerprint();
+    presenceObj["online"] = user->socket() != nullptr;
+
+    return presenceObj;
+}
+
+void ChatServer::sendPresenceSnapshot(User *user)
+{
+    QJsonArray presenceArray;
+    for (const auto &id : m_contactManager->contacts(user->id())) {
+        User *contact = m_userManager->findUserById(id);
+        if (contact) {
+            presenceArray.append(getPresenceAsJsonObject(contact));
+        }
+    }
+
+    QJsonObject response;
+    response["valid"] = true;
+    response["event"] = HttpServer::Responses::PresenceEvent;
+    response["users"] = presenceArray;
+
+    sendJson(user->socket(), response);
+}
+
+void ChatServer::sendToRoom(Room *room, const QJsonObject &event)
+{
+    if (!room) {
+        return;
+    }
+
+    // Numbered and serialized once and kept once in the room. QWebSocket can't send a prebuilt
+    // frame, so converting to UTF-8 and framing still happen for every member.
+    const QString frame = room->replayRing().append(encode(event));
+
+    for (const auto &member : room->members()) {
+        if (member->socket()) {
+            member->socket()->sendTextMessage(frame);
+        }
+    }
+}
+
+QString ChatServer::encode(const QJsonObject &event)
+{
+    return QString::fromUtf8(QJsonDocument(event).toJson(QJsonDocument::Compact));
+}
+
+void ChatServer::deliver(User *user, const QString &event)
+{
+    const QString frame = user->replayRing().append(event);
+    if (user->socket()) {
+        user->socket()->sendTextMessage(frame);
     }
 }
 
@@ -247,7 +1067,7 @@ QJsonArray ChatServer::getUserListAsJsonObject(const QList<User*>& list) {
 
         userObj["id"] = user->id();
         userObj["name"] = user->name();
-        userObj["publicKey"] = user->publicKey();
+        userObj["keyFingerprint"] = user->keyFingerprint();
 
         userArray.append(userObj);
     }
@@ -256,16 +1076,75 @@ QJsonArray ChatServer::getUserListAsJsonObject(const QList<User*>& list) {
 }
 
 void ChatServer::sendUserListChange() {
+    TraceSpan span("sendUserListChange", "presence");
+
     const auto &activeUsers = m_userManager->activeUsers();
-    QJsonArray userArray = getUserListAsJsonObject(activeUsers);
 
     QJsonObject response;
     response["event"] = HttpServer::Responses::UserlistChangeEvent;
-    response["users"] = userArray;
+    response["users"] = getUserListAsJsonObject(activeUsers);
 
+    const QString frame = encode(response);
     for (const auto &user : activeUsers) {
-        if (user->socket()) {
-            user->socket()->sendTextMessage(QString::fromUtf8(QJsonDocument(response).toJson()));
+        user->socket()->sendTextMessage(frame);
+    }
+}
+
+void ChatServer::queuePresenceChange(User *user)
+{
+    // A reconnect reports the old socket going away and the new one arriving, subscribers only need the end state.
+    if (m_pendingPresence.isEmpty()) {
+        QTimer::singleShot(0, this, &ChatServer::sendPresenceChanges);
+    }
+
+    m_pendingPresence.insert(user);
+}
+
+void ChatServer::sendPresenceChanges()
+{
+    TraceSpan span("sendPresenceChanges", "presence");
+
+    const QSet<User*> changed = m_pendingPresence;
+    m_pendingPresence.clear();
+
+    if (m_presenceMode == DirectoryPresence) {
+        QJsonArray presenceArray;
+        for (User *user : changed) {
+            presenceArray.append(getPresenceAsJsonObject(user));
+        }
+
+        QJsonObject response;
+        response["valid"] = true;
+        response["event"] = HttpServer::Responses::PresenceEvent;
+        response["users"] = presenceArray;
+
+        // Only what changed, encoded once for every active user.
+        const QString frame = encode(response);
+        for (User *user : m_userManager->activeUsers()) {
+            user->socket()->sendTextMessage(frame);
+        }
+
+        return;
+    }
+
+    for (User *user : changed) {
+        const QSet<QString> subscribers = m_contactManager->subscribers(user->id());
+        if (subscribers.isEmpty()) {
+            continue;
+        }
+
+        QJsonObject response;
+        response["valid"] = true;
+        response["event"] = HttpServer::Responses::PresenceEvent;
+        response["users"] = QJsonArray { getPresenceAsJsonObject(user) };
+
+        // Encoded once and sent to the subscribers only, instead of the full list to every active user.
+        const QString frame = encode(response);
+        for (const auto &id : subscribers) {
+            User *subscriber = m_userManager->findUserById(id);
+            if (subscriber && subscriber->socket()) {
+                subscriber->socket()->sendTextMessage(frame);
+            }
         }
     }
 }
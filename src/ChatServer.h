@@ -1,25 +1,77 @@
 #ifndef CHATSERVER_H
 #define CHATSERVER_H
 
+#include "ChatRequest.h"
+#include "FileTransferManager.h"
+#include "HttpServer.h"
+#include "SessionHandoff.h"
+#include "TrafficCapture.h"
+
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <QJsonObject>
 #include <QObject>
+#include <QSet>
 #include <QSslConfiguration>
 
+class ConnectionRegistry;
+class ContactManager;
+class Room;
+class RoomManager;
+class SessionStore;
 class User;
 class UserManager;
-class HttpServer;
 class HttpsServer;
 class QWebSocket;
 class QWebSocketServer;
+class QTimer;
 
 class ChatServer : public QObject {
 
     Q_OBJECT
 
 public:
+    enum PresenceMode {
+        // Every active user gets the whole list of active users on every change.
+        BroadcastPresence,
+        // Every active user hears about the users who changed, the list itself is paged through the directory.
+        DirectoryPresence,
+        // Users only hear about the contacts they subscribed to.
+        ContactPresence
+    };
+
+    typedef void (ChatServer::*RequestHandler)(const ChatRequest &request, QWebSocket *socket, User *user);
+
+    struct RequestDescriptor {
+        HttpServer::Requests action;
+        const char *name;
+        // Bitmask of (1 << ChatRequest::Field) which must be present and non-empty.
+        unsigned requiredFields;
+        // Resolve the token to a user before calling the handler, reject the request otherwise.
+        bool requiresAuth;
+        // Event used when the dispatcher rejects the request, -1 drops it silently.
+        int errorEvent;
+        RequestHandler handler;
+    };
+
     explicit ChatServer(QObject *parent = nullptr);
 
+    static const RequestDescriptor *requestDescriptor(int action);
+    // "broadcast" or "contacts", anything else is broadcast and clears ok.
+    static PresenceMode presenceModeFromString(const QString &name, bool *ok = nullptr);
+
     void setupSSL(const QString &sslCertificate, const QString &sslPrivateKey);
+    void setUpgradeSocket(const QString &path);
+    void setSessionSnapshot(const QString &path, int intervalSeconds, bool journal);
+    bool setSessionTokens(const QString &keyFile, int lifetimeSeconds);
+    void setHttpConnectionLimits(const HttpServer::ConnectionLimits &limits);
+    void setReplayBufferSize(int events);
+    void setHttp2Enabled(bool enabled);
+    bool setCapture(const QString &path, TrafficCapture::Redaction redaction);
+    void setPresenceMode(PresenceMode mode);
+
+    // Port of the WebSocket listener once started.
+    quint16 serverPort() const;
 
 public slots:
     void start(const QString &ip, int httpPort, int httpsPort = 8443,
@@ -30,16 +82,73 @@ public slots:
 private slots:
     void onNewConnection();
     void handleMessage(const QString &message, QWebSocket *socket);
+    void handleBinaryMessage(const QByteArray &frame, QWebSocket *socket);
     void sendUserListChange();
+    void queuePresenceChange(User *user);
+    void leaveRooms(User *user);
+    void sendPresenceChanges();
+    void drain();
+    void finishDrain();
 
 private:
     HttpServer *m_httpServer = nullptr;
     HttpsServer *m_httpsServer = nullptr;
     QJsonArray getUserListAsJsonObject(const QList<User *> &list);
+    QJsonObject getRoomAsJsonObject(Room *room);
+    QJsonObject getPresenceAsJsonObject(User *user);
+    void sendPresenceSnapshot(User *user);
+    void sendToRoom(Room *room, const QJsonObject &event);
+    void sendJson(QWebSocket *socket, const QJsonObject &object);
+    // Sequenced delivery, the event is numbered and kept for replay even while the user is disconnected.
+    void deliver(User *user, const QString &event);
+    static QString encode(const QJsonObject &event);
+    void sendError(QWebSocket *socket, int event, const QString &error);
+    bool listenOrInherit(HttpServer *server, SessionHandoff::Listener listener, int port);
+
+    void handleLoginRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handleRegisterRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handleLogoutRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handleMessageRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handleAuthorizeRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handleCreateRoomRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handleJoinRoomRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handleLeaveRoomRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handleRoomMessageRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handlePublicKeysRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handleDirectoryRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handleSubscribePresenceRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handleUnsubscribePresenceRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handleFileOfferRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handleFileAcceptRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handleFileCreditRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+    void handleFileCancelRequest(const ChatRequest &request, QWebSocket *socket, User *user);
+
+    void loginUser(User *user, const ChatRequest &request, QWebSocket *socket);
+    void sendTransferEvent(QWebSocket *socket, quint32 transfer, const QString &state, QJsonObject event = QJsonObject());
+    void cancelTransfer(FileTransferManager::Transfer *transfer, const QString &reason);
+    void cancelTransfersOf(QWebSocket *socket);
 
     QWebSocketServer *m_webSocketServer = nullptr;
     UserManager *m_userManager = nullptr;
+    RoomManager *m_roomManager = nullptr;
+    SessionHandoff *m_sessionHandoff = nullptr;
+    SessionStore *m_sessionStore = nullptr;
+    ConnectionRegistry *m_connections = nullptr;
+    ContactManager *m_contactManager = nullptr;
+    FileTransferManager *m_fileTransfers = nullptr;
+    QString m_upgradeSocket = "";
     QSslConfiguration m_sslConfiguration;
+    HttpServer::ConnectionLimits m_httpConnectionLimits;
+    bool m_http2Enabled = true;
+    TrafficCapture m_capture;
+    PresenceMode m_presenceMode = BroadcastPresence;
+    QTimer *m_drainTimer = nullptr;
+    QElapsedTimer m_drainStarted;
+    bool m_handedOver = false;
+    // Users whose presence changed since the last fan-out, sent together once control returns to the event loop.
+    QSet<User*> m_pendingPresence;
+
+    static const RequestDescriptor s_requestTable[HttpServer::RequestCount];
 };
 
 
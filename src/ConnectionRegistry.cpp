@@ -0,0 +1,97 @@
+#include "ConnectionRegistry.h"
+
+#include <QDateTime>
+#include <QWebSocket>
+
+ConnectionRegistry::ConnectionRegistry(QObject *parent) : QObject(parent)
+{
+}
+
+ConnectionRegistry::Connection *ConnectionRegistry::open(QWebSocket *socket)
+{
+    Connection *connection = acquire();
+    connection->id = m_nextId++;
+    connection->socket = socket;
+    touch(connection);
+
+    m_connections.insert(socket, connection);
+
+    connect(socket, &QWebSocket::disconnected, this, [this, socket]() {
+        Connection *connection = m_connections.take(socket);
+        if (!connection) {
+            return;
+        }
+
+        // Nothing may reach the recycled slot once the socket is gone.
+        disconnect(socket, &QWebSocket::textMessageReceived, nullptr, nullptr);
+        disconnect(socket, &QWebSocket::binaryMessageReceived, nullptr, nullptr);
+        socket->deleteLater();
+
+        emit connectionClosed(connection->id);
+
+        release(connection);
+    });
+
+    return connection;
+}
+
+ConnectionRegistry::Connection *ConnectionRegistry::find(QWebSocket *socket) const
+{
+    return m_connections.value(socket, nullptr);
+}
+
+void ConnectionRegistry::touch(Connection *connection)
+{
+    connection->lastActivity = QDateTime::currentMSecsSinceEpoch();
+    // Kept on write, the drain polls it and would otherwise scan every connection.
+    m_lastActivity = qMax(m_lastActivity, connection->lastActivity);
+}
+
+void ConnectionRegistry::closeAll(QWebSocketProtocol::CloseCode code, const QString &reason)
+{
+    const auto sockets = m_connections.keys();
+    for (QWebSocket *socket : sockets) {
+        socket->close(code, reason);
+    }
+}
+
+int ConnectionRegistry::count() const
+{
+    return m_connections.size();
+}
+
+qint64 ConnectionRegistry::lastActivity() const
+{
+    return m_lastActivity;
+}
+
+int ConnectionRegistry::capacity() const
+{
+    return static_cast<int>(m_slabs.size()) * slabSize;
+}
+
+ConnectionRegistry::Connection *ConnectionRegistry::acquire()
+{
+    if (!m_freeList) {
+        m_slabs.emplace_back(new Connection[slabSize]);
+
+        Connection *slab = m_slabs.back().get();
+        for (int i = 0; i < slabSize; ++i) {
+            slab[i].nextFree = (i + 1 < slabSize) ? &slab[i + 1] : nullptr;
+        }
+        m_freeList = slab;
+    }
+
+    Connection *connection = m_freeList;
+    m_freeList = connection->nextFree;
+    connection->nextFree = nullptr;
+
+    return connection;
+}
+
+void ConnectionRegistry::release(Connection *connection)
+{
+    *connection = Connection();
+    connection->nextFree = m_freeList;
+    m_freeList = connection;
+}
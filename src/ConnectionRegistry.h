@@ -0,0 +1,63 @@
+#ifndef CONNECTIONREGISTRY_H
+#define CONNECTIONREGISTRY_H
+
+#include <QHash>
+#include <QObject>
+#include <QWebSocketProtocol>
+
+#include <memory>
+#include <vector>
+
+class QWebSocket;
+
+// Tracks every WebSocket connection from accept to teardown. Per-connection state lives in
+// slots carved out of fixed-size slabs and recycled through a free list, so connect/disconnect
+// churn reuses memory instead of growing it. Sockets are deleted once they disconnect. The
+// session (token, replay ring, rooms) stays on User, it outlives the connection for resuming.
+class ConnectionRegistry : public QObject {
+
+    Q_OBJECT
+
+public:
+    struct Connection {
+        quint64 id = 0;
+        QWebSocket *socket = nullptr;
+        // Last frame received, in msecs since the epoch.
+        qint64 lastActivity = 0;
+
+        Connection *nextFree = nullptr;
+    };
+
+    explicit ConnectionRegistry(QObject *parent = nullptr);
+
+    Connection *open(QWebSocket *socket);
+    Connection *find(QWebSocket *socket) const;
+    // Records a frame received on the connection.
+    void touch(Connection *connection);
+
+    void closeAll(QWebSocketProtocol::CloseCode code, const QString &reason);
+
+    int count() const;
+    // Most recent activity of any connection, closed ones included, in msecs since the epoch.
+    qint64 lastActivity() const;
+    int capacity() const;
+
+signals:
+    void connectionClosed(quint64 id);
+
+private:
+    Connection *acquire();
+    void release(Connection *connection);
+
+private:
+    static const int slabSize = 256;
+
+    std::vector<std::unique_ptr<Connection[]>> m_slabs;
+    Connection *m_freeList = nullptr;
+
+    QHash<QWebSocket*, Connection*> m_connections;
+    quint64 m_nextId = 1;
+    qint64 m_lastActivity = 0;
+};
+
+#endif // CONNECTIONREGISTRY_H
@@ -0,0 +1,139 @@
+#include "ContactManager.h"
+#include "Logger.h"
+#include "Tracer.h"
+
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+
+ContactManager::ContactManager(QObject *parent) : QObject(parent)
+{
+    QSqlQuery query;
+    query.exec("CREATE TABLE IF NOT EXISTS contacts (owner TEXT, contact TEXT, PRIMARY KEY (owner, contact))");
+}
+
+void ContactManager::loadContacts()
+{
+    m_contacts.clear();
+    m_subscribers.clear();
+
+    QSqlQuery query("SELECT owner, contact FROM contacts");
+    while (query.next()) {
+        const QString owner = query.value(0).toString();
+        const QString contact = query.value(1).toString();
+
+        m_contacts[owner].insert(contact);
+        m_subscribers[contact].insert(owner);
+    }
+}
+
+QStringList ContactManager::addContacts(const QString &ownerId, const QStringList &contactIds)
+{
+    TraceSpan span("addContacts", "sql");
+
+    const QSet<QString> existing = m_contacts.value(ownerId);
+
+    QStringList added;
+    for (const QString &contactId : contactIds) {
+        if (contactId != ownerId && !existing.contains(contactId) && !added.contains(contactId)) {
+            added.append(contactId);
+        }
+    }
+
+    if (added.isEmpty()) {
+        return added;
+    }
+
+    // One transaction per request, SQLite would otherwise sync once per row.
+    QSqlDatabase database = QSqlDatabase::database();
+    database.transaction();
+
+    QSqlQuery query;
+    query.prepare("INSERT OR IGNORE INTO contacts (owner, contact) VALUES (:owner, :contact)");
+    for (const QString &contactId : qAsConst(added)) {
+        query.bindValue(":owner", ownerId);
+        query.bindValue(":contact", contactId);
+        if (!query.exec()) {
+            qCWarning(lcUsers) << "Couldn't save contacts of" << ownerId << query.lastError().text();
+            database.rollback();
+
+            return QStringList();
+        }
+    }
+
+    database.commit();
+
+    QSet<QString> &contacts = m_contacts[ownerId];
+    for (const QString &contactId : qAsConst(added)) {
+        contacts.insert(contactId);
+        m_subscribers[contactId].insert(ownerId);
+    }
+
+    return added;
+}
+
+QStringList ContactManager::removeContacts(const QString &ownerId, const QStringList &contactIds)
+{
+    TraceSpan span("removeContacts", "sql");
+
+    const QSet<QString> existing = m_contacts.value(ownerId);
+
+    QStringList removed;
+    for (const QString &contactId : contactIds) {
+        if (existing.contains(contactId) && !removed.contains(contactId)) {
+            removed.append(contactId);
+        }
+    }
+
+    if (removed.isEmpty()) {
+        return removed;
+    }
+
+    QSqlDatabase database = QSqlDatabase::database();
+    database.transaction();
+
+    QSqlQuery query;
+    query.prepare("DELETE FROM contacts WHERE owner = :owner AND contact = :contact");
+    for (const QString &contactId : qAsConst(removed)) {
+        query.bindValue(":owner", ownerId);
+        query.bindValue(":contact", contactId);
+        if (!query.exec()) {
+            qCWarning(lcUsers) << "Couldn't remove contacts of" << ownerId << query.lastError().text();
+            database.rollback();
+
+            return QStringList();
+        }
+    }
+
+    database.commit();
+
+    QSet<QString> &contacts = m_contacts[ownerId];
+    for (const QString &contactId : qAsConst(removed)) {
+        contacts.remove(contactId);
+
+        auto subscribers = m_subscribers.find(contactId);
+        if (subscribers != m_subscribers.end()) {
+            subscribers->remove(ownerId);
+            if (subscribers->isEmpty()) {
+                m_subscribers.erase(subscribers);
+            }
+        }
+    }
+
+    if (contacts.isEmpty()) {
+        m_contacts.remove(ownerId);
+    }
+
+    return removed;
+}
+
+QSet<QString> ContactManager::contacts(const QString &ownerId) const
+{
+    return m_contacts.value(ownerId);
+}
+
+QSet<QString> ContactManager::subscribers(const QString &userId) const
+{
+    return m_subscribers.value(userId);
+}
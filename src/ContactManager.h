@@ -0,0 +1,33 @@
+#ifndef CONTACTMANAGER_H
+#define CONTACTMANAGER_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+
+// Contact lists used for presence subscriptions, persisted in the "contacts" table of the user
+// database. Both directions are indexed in memory: the contacts of a user for its presence
+// snapshot, and the subscribers of a user for fanning out its presence changes.
+class ContactManager : public QObject {
+
+    Q_OBJECT
+
+public:
+    explicit ContactManager(QObject *parent = nullptr);
+
+    void loadContacts();
+
+    // Returns the ids which weren't already in, respectively still in, the contact list.
+    QStringList addContacts(const QString &ownerId, const QStringList &contactIds);
+    QStringList removeContacts(const QString &ownerId, const QStringList &contactIds);
+
+    QSet<QString> contacts(const QString &ownerId) const;
+    QSet<QString> subscribers(const QString &userId) const;
+
+private:
+    QHash<QString, QSet<QString>> m_contacts;
+    QHash<QString, QSet<QString>> m_subscribers;
+};
+
+#endif // CONTACTMANAGER_H
@@ -0,0 +1,158 @@
+#include "FileTransferManager.h"
+
+#include <QWebSocket>
+#include <QtEndian>
+
+FileTransferManager::FileTransferManager(QObject *parent) : QObject(parent)
+{
+}
+
+FileTransferManager::~FileTransferManager()
+{
+    qDeleteAll(m_transfers);
+}
+
+FileTransferManager::Transfer *FileTransferManager::offer(User *sender, QWebSocket *senderSocket, User *receiver,
+                                                          QWebSocket *receiverSocket, const QString &name, qint64 size)
+{
+    Transfer *transfer = new Transfer;
+    transfer->id = m_nextId++;
+    transfer->sender = sender;
+    transfer->receiver = receiver;
+    transfer->senderSocket = senderSocket;
+    transfer->receiverSocket = receiverSocket;
+    transfer->name = name;
+    transfer->size = size;
+
+    m_transfers.insert(transfer->id, transfer);
+    m_transfersBySocket.insert(senderSocket, transfer);
+    m_transfersBySocket.insert(receiverSocket, transfer);
+
+    connect(receiverSocket, &QWebSocket::bytesWritten, this, &FileTransferManager::releaseCredit, Qt::UniqueConnection);
+
+    return transfer;
+}
+
+FileTransferManager::Transfer *FileTransferManager::find(quint32 id) const
+{
+    return m_transfers.value(id, nullptr);
+}
+
+void FileTransferManager::accept(Transfer *transfer)
+{
+    transfer->state = Active;
+}
+
+int FileTransferManager::grantCredit(Transfer *transfer, int credit)
+{
+    const int granted = qBound(0, credit, maxCredit - transfer->credit - transfer->withheldCredit);
+
+    // Chunks would only pile up in the receiver's write buffer, the sender waits until it drained.
+    if (isBackedUp(transfer->receiverSocket)) {
+        transfer->withheldCredit += granted;
+        return 0;
+    }
+
+    transfer->credit += granted;
+
+    return granted;
+}
+
+void FileTransferManager::releaseCredit()
+{
+    QWebSocket *socket = qobject_cast<QWebSocket*>(sender());
+    if (!socket || isBackedUp(socket)) {
+        return;
+    }
+
+    for (Transfer *transfer : transfersOf(socket)) {
+        if (transfer->receiverSocket == socket && transfer->withheldCredit > 0) {
+            const int released = transfer->withheldCredit;
+            transfer->credit += released;
+            transfer->withheldCredit = 0;
+
+            emit creditReleased(transfer, released);
+        }
+    }
+}
+
+bool FileTransferManager::isBackedUp(QWebSocket *receiverSocket)
+{
+    return receiverSocket->bytesToWrite() > maxBufferedBytes;
+}
+
+FileTransferManager::ChunkResult FileTransferManager::forwardChunk(QWebSocket *socket, const QByteArray &frame,
+                                                                   Transfer **transfer, QString *error)
+{
+    if (frame.size() < headerSize) {
+        *error = QStringLiteral("Chunk header is missing.");
+        return UnknownTransfer;
+    }
+
+    const quint32 id = qFromLittleEndian<quint32>(frame.constData());
+    const quint32 index = qFromLittleEndian<quint32>(frame.constData() + 4);
+
+    Transfer *found = m_transfers.value(id, nullptr);
+    if (!found || found->senderSocket != socket) {
+        *error = QStringLiteral("Unknown transfer.");
+        return UnknownTransfer;
+    }
+
+    *transfer = found;
+
+    const int payloadSize = frame.size() - headerSize;
+
+    if (found->state != Active || found->credit <= 0) {
+        *error = QStringLiteral("Chunk sent without credit.");
+        return ChunkRejected;
+    }
+
+    if (index != found->nextChunk) {
+        *error = QStringLiteral("Chunk out of order.");
+        return ChunkRejected;
+    }
+
+    if (payloadSize <= 0 || payloadSize > chunkSize || found->transferred + payloadSize > found->size) {
+        *error = QStringLiteral("Invalid chunk size.");
+        return ChunkRejected;
+    }
+
+    --found->credit;
+    ++found->nextChunk;
+    found->transferred += payloadSize;
+
+    // The frame goes out as received, header included, without being decoded or copied here.
+    found->receiverSocket->sendBinaryMessage(frame);
+
+    return found->transferred == found->size ? TransferCompleted : ChunkForwarded;
+}
+
+void FileTransferManager::remove(Transfer *transfer)
+{
+    if (!transfer) {
+        return;
+    }
+
+    m_transfers.remove(transfer->id);
+    m_transfersBySocket.remove(transfer->senderSocket, transfer);
+    m_transfersBySocket.remove(transfer->receiverSocket, transfer);
+
+    delete transfer;
+}
+
+QList<FileTransferManager::Transfer *> FileTransferManager::transfersOf(QWebSocket *socket) const
+{
+    return m_transfersBySocket.values(socket);
+}
+
+int FileTransferManager::outgoingCount(QWebSocket *senderSocket) const
+{
+    int count = 0;
+    for (auto it = m_transfersBySocket.find(senderSocket); it != m_transfersBySocket.end() && it.key() == senderSocket; ++it) {
+        if (it.value()->senderSocket == senderSocket) {
+            ++count;
+        }
+    }
+
+    return count;
+}
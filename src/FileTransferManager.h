@@ -0,0 +1,93 @@
+#ifndef FILETRANSFERMANAGER_H
+#define FILETRANSFERMANAGER_H
+
+#include <QHash>
+#include <QMultiHash>
+#include <QObject>
+
+class QWebSocket;
+class User;
+
+// Relays files between two connected users. The transfer is set up over JSON requests, the
+// chunks travel as binary frames of an 8 byte header (u32 LE transfer id, u32 LE chunk index)
+// followed by at most chunkSize bytes, and each chunk is forwarded to the receiver as soon as
+// it arrives. The sender may only send as many chunks as the receiver granted credit for, so
+// the server never holds more than maxCredit chunks of a transfer, whatever the file size. While
+// more than maxBufferedBytes wait to be written to the receiver, credit it grants is withheld
+// from the sender until the connection caught up.
+class FileTransferManager : public QObject {
+
+    Q_OBJECT
+
+public:
+    enum State {
+        Offered,
+        Active
+    };
+
+    enum ChunkResult {
+        ChunkForwarded,
+        TransferCompleted,
+        UnknownTransfer,
+        ChunkRejected
+    };
+
+    struct Transfer {
+        quint32 id = 0;
+        User *sender = nullptr;
+        User *receiver = nullptr;
+        QWebSocket *senderSocket = nullptr;
+        QWebSocket *receiverSocket = nullptr;
+        QString name;
+        qint64 size = 0;
+        qint64 transferred = 0;
+        quint32 nextChunk = 0;
+        // Chunks the sender may still send.
+        int credit = 0;
+        // Granted by the receiver while its connection was backed up, not passed on yet.
+        int withheldCredit = 0;
+        State state = Offered;
+    };
+
+    static const int headerSize = 8;
+    static const int chunkSize = 64 * 1024;
+    static const int maxCredit = 16;
+    static const qint64 maxBufferedBytes = qint64(maxCredit) * chunkSize;
+
+    explicit FileTransferManager(QObject *parent = nullptr);
+    ~FileTransferManager() override;
+
+    Transfer *offer(User *sender, QWebSocket *senderSocket, User *receiver, QWebSocket *receiverSocket,
+                    const QString &name, qint64 size);
+    Transfer *find(quint32 id) const;
+
+    void accept(Transfer *transfer);
+    // Returns the credit passed on to the sender, the outstanding credit never exceeds maxCredit.
+    int grantCredit(Transfer *transfer, int credit);
+
+    // Checks a binary frame against its transfer and forwards it to the receiver. On
+    // ChunkRejected the transfer is left for the caller to cancel, error tells why.
+    ChunkResult forwardChunk(QWebSocket *socket, const QByteArray &frame, Transfer **transfer, QString *error);
+
+    void remove(Transfer *transfer);
+
+    QList<Transfer *> transfersOf(QWebSocket *socket) const;
+    int outgoingCount(QWebSocket *senderSocket) const;
+
+signals:
+    // Withheld credit was passed on once the receiver's connection drained.
+    void creditReleased(FileTransferManager::Transfer *transfer, int credit);
+
+private slots:
+    void releaseCredit();
+
+private:
+    static bool isBackedUp(QWebSocket *receiverSocket);
+
+    QHash<quint32, Transfer*> m_transfers;
+    // Both ends of every transfer, so a closing socket finds its transfers without a scan.
+    QMultiHash<QWebSocket*, Transfer*> m_transfersBySocket;
+    quint32 m_nextId = 1;
+};
+
+#endif // FILETRANSFERMANAGER_H
@@ -0,0 +1,233 @@
+#include "Http2Connection.h"
+#include "HttpServer.h"
+#include "Logger.h"
+
+#include <QDateTime>
+#include <QSslSocket>
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const uint32_t maxConcurrentStreams = 100;
+
+// Stop handing frames to the socket once this much is queued, resume on bytesWritten.
+const qint64 writeHighWaterMark = 256 * 1024;
+
+nghttp2_nv header(const QByteArray &name, const QByteArray &value)
+{
+    nghttp2_nv nv;
+    nv.name = reinterpret_cast<uint8_t *>(const_cast<char *>(name.constData()));
+    nv.namelen = static_cast<size_t>(name.size());
+    nv.value = reinterpret_cast<uint8_t *>(const_cast<char *>(value.constData()));
+    nv.valuelen = static_cast<size_t>(value.size());
+    nv.flags = NGHTTP2_NV_FLAG_NONE;
+
+    return nv;
+}
+
+}
+
+Http2Connection::Http2Connection(QSslSocket *socket, HttpServer *server)
+    : QObject(socket)
+    , m_socket(socket)
+    , m_server(server)
+{
+    nghttp2_session_callbacks *callbacks = nullptr;
+    nghttp2_session_callbacks_new(&callbacks);
+    nghttp2_session_callbacks_set_send_callback(callbacks, &Http2Connection::sendCallback);
+    nghttp2_session_callbacks_set_on_begin_headers_callback(callbacks, &Http2Connection::beginHeadersCallback);
+    nghttp2_session_callbacks_set_on_header_callback(callbacks, &Http2Connection::headerCallback);
+    nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, &Http2Connection::frameReceivedCallback);
+    nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, &Http2Connection::streamClosedCallback);
+
+    nghttp2_session_server_new(&m_session, callbacks, this);
+    nghttp2_session_callbacks_del(callbacks);
+
+    const nghttp2_settings_entry settings[] = {
+        { NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, maxConcurrentStreams }
+    };
+    nghttp2_submit_settings(m_session, NGHTTP2_FLAG_NONE, settings, sizeof(settings) / sizeof(settings[0]));
+
+    connect(m_socket, &QSslSocket::readyRead, this, &Http2Connection::onReadyRead);
+    connect(m_socket, &QSslSocket::encryptedBytesWritten, this, &Http2Connection::flush);
+
+    // The client preface may have arrived together with the end of the handshake.
+    if (m_socket->bytesAvailable() > 0) {
+        onReadyRead();
+    } else {
+        flush();
+    }
+}
+
+Http2Connection::~Http2Connection()
+{
+    nghttp2_session_del(m_session);
+}
+
+void Http2Connection::onReadyRead()
+{
+    const QByteArray data = m_socket->readAll();
+
+    emit activity();
+
+    const ssize_t processed = nghttp2_session_mem_recv(m_session, reinterpret_cast<const uint8_t *>(data.constData()),
+                                                       static_cast<size_t>(data.size()));
+    if (processed < 0) {
+        qCDebug(lcHttp) << "Closing HTTP/2 connection from" << m_socket->peerAddress() << nghttp2_strerror(static_cast<int>(processed));
+        m_socket->disconnectFromHost();
+        return;
+    }
+
+    flush();
+}
+
+void Http2Connection::flush()
+{
+    if (nghttp2_session_send(m_session) != 0) {
+        m_socket->disconnectFromHost();
+        return;
+    }
+
+    // Both sides are done, e.g. after a GOAWAY.
+    if (!nghttp2_session_want_read(m_session) && !nghttp2_session_want_write(m_session)) {
+        m_socket->disconnectFromHost();
+    }
+}
+
+void Http2Connection::respond(int32_t streamId)
+{
+    auto stream = m_streams.find(streamId);
+    if (stream == m_streams.end() || stream->responded) {
+        return;
+    }
+    stream->responded = true;
+
+    const HttpServer::Response response = m_server->route(stream->method, stream->path, m_socket->peerAddress());
+
+    // HTTP/2 header names are lower case and the status line is reduced to its code.
+    const QByteArray status = response.status.left(3);
+    const QByteArray contentLength = QByteArray::number(response.body.size());
+    const QByteArray date = QDateTime::currentDateTime().toString(Qt::RFC2822Date).toLatin1();
+
+    QList<QPair<QByteArray, QByteArray>> extraHeaders;
+    for (const auto &extraHeader : response.headers) {
+        extraHeaders.append(qMakePair(extraHeader.first.toLower(), extraHeader.second));
+    }
+
+    static const QByteArray statusName(":status");
+    static const QByteArray contentTypeName("content-type");
+    static const QByteArray contentLengthName("content-length");
+    static const QByteArray dateName("date");
+
+    // nghttp2 copies the headers on submit, they only have to outlive that call.
+    std::vector<nghttp2_nv> headers;
+    headers.push_back(header(statusName, status));
+    headers.push_back(header(contentTypeName, response.contentType));
+    headers.push_back(header(contentLengthName, contentLength));
+    headers.push_back(header(dateName, date));
+    for (const auto &extraHeader : extraHeaders) {
+        headers.push_back(header(extraHeader.first, extraHeader.second));
+    }
+
+    stream->body = response.body;
+
+    nghttp2_data_provider provider;
+    provider.source.ptr = nullptr;
+    provider.read_callback = &Http2Connection::readBodyCallback;
+
+    nghttp2_submit_response(m_session, streamId, headers.data(), headers.size(),
+                            response.body.isEmpty() ? nullptr : &provider);
+}
+
+ssize_t Http2Connection::sendCallback(nghttp2_session *, const uint8_t *data, size_t length, int, void *userData)
+{
+    auto connection = static_cast<Http2Connection *>(userData);
+
+    if (connection->m_socket->encryptedBytesToWrite() + connection->m_socket->bytesToWrite() > writeHighWaterMark) {
+        return NGHTTP2_ERR_WOULDBLOCK;
+    }
+
+    const qint64 written = connection->m_socket->write(reinterpret_cast<const char *>(data), static_cast<qint64>(length));
+    if (written < 0) {
+        return NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
+
+    return static_cast<ssize_t>(written);
+}
+
+int Http2Connection::beginHeadersCallback(nghttp2_session *, const nghttp2_frame *frame, void *userData)
+{
+    if (frame->hd.type == NGHTTP2_HEADERS && frame->headers.cat == NGHTTP2_HCAT_REQUEST) {
+        static_cast<Http2Connection *>(userData)->m_streams.insert(frame->hd.stream_id, Stream());
+    }
+
+    return 0;
+}
+
+int Http2Connection::headerCallback(nghttp2_session *, const nghttp2_frame *frame,
+                                    const uint8_t *name, size_t nameLength, const uint8_t *value, size_t valueLength,
+                                    uint8_t, void *userData)
+{
+    if (frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_REQUEST) {
+        return 0;
+    }
+
+    auto connection = static_cast<Http2Connection *>(userData);
+    auto stream = connection->m_streams.find(frame->hd.stream_id);
+    if (stream == connection->m_streams.end()) {
+        return 0;
+    }
+
+    const QByteArray headerName = QByteArray::fromRawData(reinterpret_cast<const char *>(name), static_cast<int>(nameLength));
+    const QByteArray headerValue(reinterpret_cast<const char *>(value), static_cast<int>(valueLength));
+
+    if (headerName == ":method") {
+        stream->method = headerValue;
+    } else if (headerName == ":path") {
+        stream->path = headerValue;
+    }
+
+    return 0;
+}
+
+int Http2Connection::frameReceivedCallback(nghttp2_session *, const nghttp2_frame *frame, void *userData)
+{
+    // Request bodies aren't used, the response goes out once the client finished its side.
+    if ((frame->hd.type == NGHTTP2_HEADERS || frame->hd.type == NGHTTP2_DATA)
+            && (frame->hd.flags & NGHTTP2_FLAG_END_STREAM)) {
+        static_cast<Http2Connection *>(userData)->respond(frame->hd.stream_id);
+    }
+
+    return 0;
+}
+
+int Http2Connection::streamClosedCallback(nghttp2_session *, int32_t streamId, uint32_t, void *userData)
+{
+    static_cast<Http2Connection *>(userData)->m_streams.remove(streamId);
+
+    return 0;
+}
+
+ssize_t Http2Connection::readBodyCallback(nghttp2_session *, int32_t streamId, uint8_t *buffer, size_t length,
+                                          uint32_t *dataFlags, nghttp2_data_source *, void *userData)
+{
+    auto connection = static_cast<Http2Connection *>(userData);
+    auto stream = connection->m_streams.find(streamId);
+    if (stream == connection->m_streams.end()) {
+        return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+    }
+
+    const size_t remaining = static_cast<size_t>(stream->body.size() - stream->offset);
+    const size_t chunk = qMin(length, remaining);
+
+    std::memcpy(buffer, stream->body.constData() + stream->offset, chunk);
+    stream->offset += static_cast<int>(chunk);
+
+    if (stream->offset == stream->body.size()) {
+        *dataFlags |= NGHTTP2_DATA_FLAG_EOF;
+    }
+
+    return static_cast<ssize_t>(chunk);
+}
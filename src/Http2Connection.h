@@ -0,0 +1,61 @@
+#ifndef HTTP2CONNECTION_H
+#define HTTP2CONNECTION_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+
+#include <nghttp2/nghttp2.h>
+
+class HttpServer;
+class QSslSocket;
+
+// Serves an HTTPS connection which negotiated "h2" through ALPN. Framing, HPACK and flow
+// control are left to nghttp2; every request stream is resolved by HttpServer::route(),
+// so HTTP/2 clients get the same responses and cached files as HTTP/1.1 ones.
+class Http2Connection : public QObject {
+
+    Q_OBJECT
+
+public:
+    // Becomes a child of socket and goes away with it.
+    Http2Connection(QSslSocket *socket, HttpServer *server);
+    ~Http2Connection() override;
+
+signals:
+    void activity();
+
+private slots:
+    void onReadyRead();
+    void flush();
+
+private:
+    struct Stream {
+        QByteArray method;
+        QByteArray path;
+        QByteArray body;
+        int offset = 0;
+        bool responded = false;
+    };
+
+    static ssize_t sendCallback(nghttp2_session *session, const uint8_t *data, size_t length, int flags, void *userData);
+    static int beginHeadersCallback(nghttp2_session *session, const nghttp2_frame *frame, void *userData);
+    static int headerCallback(nghttp2_session *session, const nghttp2_frame *frame,
+                              const uint8_t *name, size_t nameLength, const uint8_t *value, size_t valueLength,
+                              uint8_t flags, void *userData);
+    static int frameReceivedCallback(nghttp2_session *session, const nghttp2_frame *frame, void *userData);
+    static int streamClosedCallback(nghttp2_session *session, int32_t streamId, uint32_t errorCode, void *userData);
+    static ssize_t readBodyCallback(nghttp2_session *session, int32_t streamId, uint8_t *buffer, size_t length,
+                                    uint32_t *dataFlags, nghttp2_data_source *source, void *userData);
+
+    void respond(int32_t streamId);
+
+private:
+    QSslSocket *m_socket = nullptr;
+    HttpServer *m_server = nullptr;
+    nghttp2_session *m_session = nullptr;
+
+    QHash<int32_t, Stream> m_streams;
+};
+
+#endif // HTTP2CONNECTION_H
@@ -1,10 +1,20 @@
 #include "HttpServer.h"
+#include "ChatServer.h"
+#include "Tracer.h"
 
 #include <QDateTime>
 #include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QMetaEnum>
 #include <QMimeDatabase>
 #include <QTcpSocket>
+#include <QTimer>
+
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#endif
 
 HttpServer::HttpServer(const QString &chatServerAddress, quint16 chatServerPort, QObject *parent)
     : QTcpServer(parent)
@@ -16,25 +26,200 @@ HttpServer::HttpServer(const QString &chatServerAddress, quint16 chatServerPort,
     connect(this, &QTcpServer::newConnection, this, &HttpServer::setupPendingSocket);
 }
 
-bool HttpServer::isValueInEnumRange(int value, const QString &enumName)
+void HttpServer::setChatServerProtocol(const QString &protocolString)
+{
+    m_chatServerProtocol = protocolString;
+}
+
+void HttpServer::setConnectionLimits(const ConnectionLimits &limits)
+{
+    m_limits = limits;
+}
+
+bool HttpServer::applyListenBacklog()
+{
+#ifdef Q_OS_UNIX
+    if (isListening() && m_limits.listenBacklog > 0) {
+        return ::listen(static_cast<int>(socketDescriptor()), m_limits.listenBacklog) == 0;
+    }
+#endif
+
+    return false;
+}
+
+int HttpServer::connectionCount() const
 {
-    const QMetaObject* metaObj = &HttpServer::staticMetaObject;
+    return m_connectionCount;
+}
+
+int HttpServer::rejectedConnectionCount() const
+{
+    return m_rejectedConnectionCount;
+}
+
+int HttpServer::pendingHandshakeCount() const
+{
+    return 0;
+}
+
+const HttpServer::ConnectionLimits &HttpServer::connectionLimits() const
+{
+    return m_limits;
+}
+
+void HttpServer::incomingConnection(qintptr socketDescriptor)
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        delete socket;
+        return;
+    }
+
+    if (trackConnection(socket)) {
+        addPendingConnection(socket);
+    }
+}
+
+bool HttpServer::trackConnection(QTcpSocket *socket)
+{
+    const QHostAddress address = socket->peerAddress();
+    int &perIpCount = m_connectionsPerIp[address];
+
+    if (m_connectionCount >= m_limits.maxConnections || perIpCount >= m_limits.maxConnectionsPerIp) {
+        if (perIpCount == 0) {
+            m_connectionsPerIp.remove(address);
+        }
+
+        ++m_rejectedConnectionCount;
+        socket->abort();
+        socket->deleteLater();
 
-    int enumIndex = metaObj->indexOfEnumerator(enumName.toLatin1());
-    if (enumIndex == -1) {
         return false;
     }
 
-    QMetaEnum metaEnum = metaObj->enumerator(enumIndex);
-    int minValue = metaEnum.keyToValue(metaEnum.key(0));
-    int maxValue = metaEnum.keyToValue(metaEnum.key(metaEnum.keyCount() - 1));
+    ++perIpCount;
+    ++m_connectionCount;
 
-    return (value >= minValue && value <= maxValue);
+    // Stop taking connections off the backlog until we're under budget again.
+    if (m_connectionCount >= m_limits.maxConnections && !m_acceptingPaused) {
+        pauseAccepting();
+        m_acceptingPaused = true;
+    }
+
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, m_limits.noDelay ? 1 : 0);
+    if (m_limits.sendBufferSize > 0) {
+        socket->setSocketOption(QAbstractSocket::SendBufferSizeSocketOption, m_limits.sendBufferSize);
+    }
+    if (m_limits.receiveBufferSize > 0) {
+        socket->setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, m_limits.receiveBufferSize);
+    }
+
+    connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    connect(socket, &QObject::destroyed, this, [this, address]() {
+        releaseConnection(address);
+    });
+
+    restartTimeout(socket, m_limits.idleTimeoutMs);
+
+    return true;
 }
 
-void HttpServer::setChatServerProtocol(const QString &protocolString)
+void HttpServer::restartTimeout(QTcpSocket *socket, int timeoutMs)
 {
-    m_chatServerProtocol = protocolString;
+    static const QString timerName = QStringLiteral("connectionTimeout");
+
+    QTimer *timer = socket->findChild<QTimer*>(timerName, Qt::FindDirectChildrenOnly);
+    if (!timer) {
+        timer = new QTimer(socket);
+        timer->setObjectName(timerName);
+        timer->setSingleShot(true);
+
+        connect(timer, &QTimer::timeout, socket, [socket]() {
+            socket->abort();
+            socket->deleteLater();
+        });
+    }
+
+    timer->start(timeoutMs);
+}
+
+void HttpServer::releaseConnection(const QHostAddress &address)
+{
+    --m_connectionCount;
+
+    auto perIpCount = m_connectionsPerIp.find(address);
+    if (perIpCount != m_connectionsPerIp.end() && --perIpCount.value() <= 0) {
+        m_connectionsPerIp.erase(perIpCount);
+    }
+
+    if (m_acceptingPaused && m_connectionCount < m_limits.maxConnections) {
+        resumeAccepting();
+        m_acceptingPaused = false;
+    }
+}
+
+QByteArray HttpServer::statusJson() const
+{
+    QJsonObject status;
+    status["connections"] = m_connectionCount;
+    status["pendingHandshakes"] = pendingHandshakeCount();
+    status["rejectedConnections"] = m_rejectedConnectionCount;
+    status["distinctClients"] = m_connectionsPerIp.size();
+    status["acceptingPaused"] = m_acceptingPaused;
+
+    return QJsonDocument(status).toJson(QJsonDocument::Compact);
+}
+
+HttpServer::Response HttpServer::statusResponse(const QHostAddress &peer) const
+{
+    // The counts tell how loaded the server is and how close to its limits, like the trace
+    // they're only for clients on this machine.
+    if (!peer.isLoopback()) {
+        return { "403 Forbidden", "text/plain", "Forbidden", {} };
+    }
+
+    return { "200 OK", "application/json", statusJson(), {} };
+}
+
+HttpServer::Response HttpServer::traceResponse(const QHostAddress &peer) const
+{
+    // The trace exposes request timings, only hand it to clients on this machine.
+    if (!peer.isLoopback()) {
+        return { "403 Forbidden", "text/plain", "Forbidden", {} };
+    }
+
+    if (!Tracer::isEnabled()) {
+        return { "404 Not Found", "text/plain", "Tracing is disabled", {} };
+    }
+
+    return { "200 OK", "application/json", Tracer::instance()->toJson(), {} };
+}
+
+HttpServer::Response HttpServer::route(const QByteArray &method, const QByteArray &path, const QHostAddress &peer)
+{
+    if (!m_redirectTo.isEmpty()) {
+        return { "301 Moved Permanently", "text/plain", QByteArray(), { qMakePair(QByteArray("Location"), m_redirectTo.toUtf8()) } };
+    }
+
+    if (method != "GET") {
+        return { "404 Not Found", "text/plain", "Page not found", {} };
+    }
+
+    if (path == "/enums.mjs") {
+        return { "200 OK", "text/javascript", m_enumsJsFile.toUtf8(), {} };
+    }
+
+    if (path == "/status") {
+        return statusResponse(peer);
+    }
+
+    if (path == "/trace") {
+        return traceResponse(peer);
+    }
+
+    const QString fileName = path == "/" ? QStringLiteral("/index.html") : QString::fromUtf8(path);
+
+    return fileResponse(fileName, QMimeDatabase().mimeTypeForFile(fileName).name());
 }
 
 void HttpServer::handleRequest()
@@ -44,82 +229,82 @@ void HttpServer::handleRequest()
         return;
     }
 
-    if (!m_redirectTo.isEmpty()) {
-        static const QString &redirectResponse = QStringLiteral("HTTP/1.1 301 Moved Permanently\r\n"
-                                                                "Location: %1\r\n"
-                                                                "Connection: close\r\n\r\n");
+    restartTimeout(socket, m_limits.idleTimeoutMs);
 
-        socket->write(redirectResponse.arg(m_redirectTo).toUtf8());
+    if (!m_redirectTo.isEmpty()) {
+        Response response = route(QByteArray(), QByteArray(), socket->peerAddress());
+        response.headers.append(qMakePair(QByteArray("Connection"), QByteArray("close")));
 
-        socket->waitForBytesWritten();
+        sendResponse(socket, response);
     } else {
         QByteArray requestData = socket->readAll();
         QList<QByteArray> requestLines = requestData.split('\n');
-        if (requestLines.isEmpty()) {
-            return;
-        }
-
-        QList<QByteArray> requestParts = requestLines.first().split(' ');
+        QList<QByteArray> requestParts = requestLines.isEmpty() ? QList<QByteArray>()
+                                                                : requestLines.first().trimmed().split(' ');
         if (requestParts.length() != 3) {
+            sendResponse(socket, { "400 Bad Request", "text/plain", "Bad request", {} });
+            socket->disconnectFromHost();
+
             return;
         }
 
-        QByteArray method = requestParts[0];
-        QByteArray path = requestParts[1];
+        const QByteArray method = requestParts[0];
+        const QByteArray path = requestParts[1];
 
+        sendResponse(socket, route(method, path, socket->peerAddress()));
 
         if (method == "GET") {
-            if (path == "/enums.mjs") {
-                sendResponse(socket, "200 OK", "text/javascript", m_enumsJsFile.toUtf8());
-            } else {
-                if (path == "/") {
-                    path = "/index.html";
-                }
-
-                serveFile(socket, path, QMimeDatabase().mimeTypeForFile(path).name());
-            }
-
             return;
-        } else {
-            sendResponse(socket, "404 Not Found", "text/plain", "Page not found");
         }
     }
 
     socket->disconnectFromHost();
 }
 
-void HttpServer::sendResponse(QTcpSocket *socket, const QByteArray &status, const QByteArray &contentType, const QByteArray &body)
+void HttpServer::sendResponse(QTcpSocket *socket, const Response &response)
 {
-    QByteArray response;
-    response.append("HTTP/1.1 " + status + "\r\n");
-    response.append("Content-Type: " + contentType + "\r\n");
-    response.append("Content-Length: " + QByteArray::number(body.length()) + "\r\n");
-    response.append("Date: " + QDateTime::currentDateTime().toString(Qt::RFC2822Date) + "\r\n");
-    response.append("\r\n");
-    response.append(body);
+    QByteArray data;
+    data.append("HTTP/1.1 " + response.status + "\r\n");
+    data.append("Content-Type: " + response.contentType + "\r\n");
+    data.append("Content-Length: " + QByteArray::number(response.body.length()) + "\r\n");
+    data.append("Date: " + QDateTime::currentDateTime().toString(Qt::RFC2822Date) + "\r\n");
+    for (const auto &header : response.headers) {
+        data.append(header.first + ": " + header.second + "\r\n");
+    }
+    data.append("\r\n");
+    data.append(response.body);
 
-    socket->write(response);
+    socket->write(data);
     socket->waitForBytesWritten();
 }
 
-void HttpServer::serveFile(QTcpSocket *socket, const QString &fileName, const QString &contentType)
+HttpServer::Response HttpServer::fileResponse(const QString &fileName, const QString &contentType)
 {
-    QFile file("html" + fileName);
+    TraceSpan span("serveFile", "http");
 
-    if (!file.exists() || !file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        sendResponse(socket, "404 Not Found", "text/plain", "File not found");
-        return;
+    const QFileInfo fileInfo("html" + fileName);
+    if (!fileInfo.isFile()) {
+        m_fileCache.remove(fileName);
+        return { "404 Not Found", "text/plain", "File not found", {} };
     }
 
-    QString fileContent = file.readAll();
+    auto cached = m_fileCache.find(fileName);
+    if (cached == m_fileCache.end() || cached->lastModified != fileInfo.lastModified()) {
+        QFile file(fileInfo.filePath());
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            return { "404 Not Found", "text/plain", "File not found", {} };
+        }
+
+        QString fileContent = file.readAll();
 
-    fileContent.replace("%SERVER_PROTOCOL%", m_chatServerProtocol);
-    fileContent.replace("%SERVER_ADDRESS%", m_chatServerAddress);
-    fileContent.replace("%SERVER_PORT%", QString::number(m_chatServerPort));
+        fileContent.replace("%SERVER_PROTOCOL%", m_chatServerProtocol);
+        fileContent.replace("%SERVER_ADDRESS%", m_chatServerAddress);
+        fileContent.replace("%SERVER_PORT%", QString::number(m_chatServerPort));
 
-    sendResponse(socket, "200 OK", contentType.toUtf8(), fileContent.toUtf8());
+        cached = m_fileCache.insert(fileName, { fileInfo.lastModified(), fileContent.toUtf8() });
+    }
 
-    file.close();
+    return { "200 OK", contentType.toUtf8(), cached->content, {} };
 }
 
 void HttpServer::generateEnumsFile()
@@ -135,6 +320,17 @@ QString HttpServer::convertEnumToJs(const QString &enumName)
     enumContents = enumContents.arg(enumName);
     enumContents += "\n";
 
+    // Requests are exported from the dispatch table, so the client only sees actions which have a handler.
+    if (enumName == QLatin1String("Requests")) {
+        for (int i = 0; i < RequestCount; ++i) {
+            enumContents += QString("%1: %2,\n").arg(QLatin1String(ChatServer::requestDescriptor(i)->name)).arg(i);
+        }
+
+        enumContents += "};\n";
+
+        return enumContents;
+    }
+
     const QMetaObject &metaObj = HttpServer::staticMetaObject;
     int enumIndex = metaObj.indexOfEnumerator(enumName.toStdString().c_str());
     if (enumIndex != -1) {
@@ -1,6 +1,11 @@
 #ifndef HTTPSERVERBASE_H
 #define HTTPSERVERBASE_H
 
+#include <QDateTime>
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QPair>
 #include <QTcpServer>
 
 class HttpServer : public QTcpServer
@@ -13,7 +18,21 @@ public:
         RegisterRequest,
         LogoutRequest,
         MessageRequest,
-        AuthorizeRequest
+        AuthorizeRequest,
+        CreateRoomRequest,
+        JoinRoomRequest,
+        LeaveRoomRequest,
+        RoomMessageRequest,
+        PublicKeysRequest,
+        DirectoryRequest,
+        SubscribePresenceRequest,
+        UnsubscribePresenceRequest,
+        FileOfferRequest,
+        FileAcceptRequest,
+        FileCreditRequest,
+        FileCancelRequest,
+
+        RequestCount
     };
 
     enum Responses {
@@ -21,26 +40,76 @@ public:
         LoginEvent,
         MessageEvent,
         InvalidUserEvent,
-        UserlistChangeEvent
+        UserlistChangeEvent,
+        RoomEvent,
+        RoomMessageEvent,
+        PublicKeysEvent,
+        DirectoryEvent,
+        PresenceEvent,
+        FileTransferEvent
     };
 
     Q_ENUM(Requests)
     Q_ENUM(Responses)
 
-    explicit HttpServer(const QString &chatServerAddress, quint16 chatServerPort, QObject *parent = nullptr);
+    struct ConnectionLimits {
+        int idleTimeoutMs = 15000;
+        int handshakeTimeoutMs = 10000;
+        int maxConnections = 1024;
+        int maxConnectionsPerIp = 32;
+        int listenBacklog = 128;
+
+        bool noDelay = true;
+        // 0 keeps the system default.
+        int sendBufferSize = 0;
+        int receiveBufferSize = 0;
+    };
 
-    bool isValueInEnumRange(int value, const QString& enumName);
+    struct Response {
+        QByteArray status;
+        QByteArray contentType;
+        QByteArray body;
+        QList<QPair<QByteArray, QByteArray>> headers;
+    };
+
+    explicit HttpServer(const QString &chatServerAddress, quint16 chatServerPort, QObject *parent = nullptr);
 
     void setRedirectTo(const QString &redirectTo);
     void setChatServerProtocol(const QString &protocolString);
 
+    void setConnectionLimits(const ConnectionLimits &limits);
+    // Qt5 always listens with its own backlog, this re-applies ours once the server is listening.
+    bool applyListenBacklog();
+
+    int connectionCount() const;
+    int rejectedConnectionCount() const;
+    virtual int pendingHandshakeCount() const;
+
+    // Resolves a request independently of the protocol version, so HTTP/1.1 and HTTP/2
+    // clients are served the same responses from the same file cache.
+    Response route(const QByteArray &method, const QByteArray &path, const QHostAddress &peer);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+    // Applies socket options, enforces the connection caps and makes sure the socket is
+    // deleted on every close path. Returns false when the socket was rejected.
+    bool trackConnection(QTcpSocket *socket);
+    void restartTimeout(QTcpSocket *socket, int timeoutMs);
+
+    const ConnectionLimits &connectionLimits() const;
+
 private:
     void handleRequest();
-    void sendResponse(QTcpSocket *socket, const QByteArray &status, const QByteArray &contentType, const QByteArray &body);
-    void serveFile(QTcpSocket *socket, const QString &fileName, const QString &contentType);
+    void sendResponse(QTcpSocket *socket, const Response &response);
+    Response fileResponse(const QString &fileName, const QString &contentType);
     void generateEnumsFile();
     QString convertEnumToJs(const QString &enumName);
     void setupPendingSocket();
+    void releaseConnection(const QHostAddress &address);
+    QByteArray statusJson() const;
+    Response statusResponse(const QHostAddress &peer) const;
+    Response traceResponse(const QHostAddress &peer) const;
 
 private:
     QString m_chatServerAddress = "";
@@ -49,6 +118,19 @@ private:
     QString m_chatServerProtocol = "ws";
 
     QString m_redirectTo = "";
+
+    ConnectionLimits m_limits;
+    int m_connectionCount = 0;
+    int m_rejectedConnectionCount = 0;
+    bool m_acceptingPaused = false;
+    QHash<QHostAddress, int> m_connectionsPerIp;
+
+    struct CachedFile {
+        QDateTime lastModified;
+        QByteArray content;
+    };
+    // Files with the server variables already substituted, refreshed when the file changes on disk.
+    QHash<QString, CachedFile> m_fileCache;
 };
 
 #endif // HTTPSERVERBASE_H
@@ -1,35 +1,108 @@
 #include "HttpsServer.h"
+#include "Logger.h"
+#include "Tracer.h"
+
+#ifdef QMESSAGESERVER_HTTP2
+#include "Http2Connection.h"
+#endif
 
 HttpsServer::HttpsServer(const QString &chatServerAddress, quint16 chatServerPort, QSslConfiguration sslConfiguration, QObject *parent)
     : HttpServer(chatServerAddress, chatServerPort, parent)
     , m_sslConfiguration(sslConfiguration)
 {
     setChatServerProtocol("wss");
+
+#ifdef QMESSAGESERVER_HTTP2
+    setHttp2Enabled(true);
+#endif
+}
+
+void HttpsServer::setHttp2Enabled(bool enabled)
+{
+#ifdef QMESSAGESERVER_HTTP2
+    QList<QByteArray> protocols;
+    if (enabled) {
+        protocols << QSslConfiguration::ALPNProtocolHTTP2;
+    }
+    protocols << QSslConfiguration::NextProtocolHttp1_1;
+
+    m_sslConfiguration.setAllowedNextProtocols(protocols);
+#else
+    if (enabled) {
+        qCDebug(lcHttp) << "Built without nghttp2, HTTPS is served over HTTP/1.1 only";
+    }
+#endif
+}
+
+bool HttpsServer::isHttp2Enabled() const
+{
+    return m_sslConfiguration.allowedNextProtocols().contains(QSslConfiguration::ALPNProtocolHTTP2);
+}
+
+int HttpsServer::pendingHandshakeCount() const
+{
+    return m_handshakingSockets.size();
 }
 
 void HttpsServer::incomingConnection(qintptr socketDescriptor)
 {
-    if (!m_sslConfiguration.isNull()) {
-        QSslSocket *sslSocket = new QSslSocket(this);
-
-        if (sslSocket->setSocketDescriptor(socketDescriptor)) {
-            connect(sslSocket, QOverload<const QList<QSslError>&>::of(&QSslSocket::sslErrors),
-                    [this, sslSocket](const QList<QSslError> &errors) {
-                        for (auto &err: errors) {
-                            qCritical() << err;
-                        }
-                    });
-
-            sslSocket->setSslConfiguration(m_sslConfiguration);
-
-            connect(sslSocket, &QSslSocket::encrypted, this, [this, sslSocket]() {
-                addPendingConnection(sslSocket);
-                emit newConnection();
+    QSslSocket *sslSocket = new QSslSocket(this);
+
+    if (!sslSocket->setSocketDescriptor(socketDescriptor)) {
+        delete sslSocket;
+        return;
+    }
+
+    if (m_sslConfiguration.isNull()) {
+        qCCritical(lcTls) << "No valid SSL configuration assigned to HTTPS server, not accepting connection.";
+        sslSocket->abort();
+        sslSocket->deleteLater();
+        return;
+    }
+
+    if (!trackConnection(sslSocket)) {
+        return;
+    }
+
+    connect(sslSocket, QOverload<const QList<QSslError>&>::of(&QSslSocket::sslErrors),
+            [this, sslSocket](const QList<QSslError> &errors) {
+                for (auto &err: errors) {
+                    qCCritical(lcTls) << err;
+                }
             });
 
-            sslSocket->startServerEncryption();
+    sslSocket->setSslConfiguration(m_sslConfiguration);
+
+    // A handshake that never finishes is reaped by the handshake timeout, and the socket is
+    // deleted by the close path set up in trackConnection().
+    m_handshakingSockets.insert(sslSocket, Tracer::now());
+    restartTimeout(sslSocket, connectionLimits().handshakeTimeoutMs);
+
+    connect(sslSocket, &QObject::destroyed, this, [this](QObject *socket) {
+        m_handshakingSockets.remove(static_cast<QSslSocket*>(socket));
+    });
+
+    connect(sslSocket, &QSslSocket::encrypted, this, [this, sslSocket]() {
+        const qint64 handshakeStart = m_handshakingSockets.take(sslSocket);
+        Tracer::record("tlsHandshake", "tls", handshakeStart, Tracer::now() - handshakeStart);
+
+        restartTimeout(sslSocket, connectionLimits().idleTimeoutMs);
+
+#ifdef QMESSAGESERVER_HTTP2
+        // Multiplexed connections never go through the HTTP/1.1 request handler.
+        if (sslSocket->sslConfiguration().nextNegotiatedProtocol() == QSslConfiguration::ALPNProtocolHTTP2) {
+            Http2Connection *connection = new Http2Connection(sslSocket, this);
+            connect(connection, &Http2Connection::activity, this, [this, sslSocket]() {
+                restartTimeout(sslSocket, connectionLimits().idleTimeoutMs);
+            });
+
+            return;
         }
-    } else {
-        qCritical() << "No valid SSL configuration assigned to HTTPS server, not accepting connection.";
-    }
+#endif
+
+        addPendingConnection(sslSocket);
+        emit newConnection();
+    });
+
+    sslSocket->startServerEncryption();
 }
@@ -3,7 +3,9 @@
 
 #include "HttpServer.h"
 
+#include <QHash>
 #include <QSslConfiguration>
+#include <QSslSocket>
 
 class HttpsServer : public HttpServer
 {
@@ -13,11 +15,19 @@ public:
     // purposefully passing QSslConfiguration by copy
     explicit HttpsServer(const QString &chatServerAddress, quint16 chatServerPort, QSslConfiguration sslConfiguration, QObject *parent = nullptr);
 
+    int pendingHandshakeCount() const override;
+
+    // Offers HTTP/2 through ALPN, only available when built with nghttp2.
+    void setHttp2Enabled(bool enabled);
+    bool isHttp2Enabled() const;
+
 protected:
     void incomingConnection(qintptr socketDescriptor) override;
 
 private:
     QSslConfiguration m_sslConfiguration;
+    // Handshake start times, for tracing.
+    QHash<QSslSocket*, qint64> m_handshakingSockets;
 };
 
 #endif // HTTPSERVER_H
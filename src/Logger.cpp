@@ -0,0 +1,468 @@
+#include "Logger.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <chrono>
+#include <cstdio>
+
+Q_LOGGING_CATEGORY(lcServer, "qmessage.server")
+Q_LOGGING_CATEGORY(lcHttp, "qmessage.http")
+Q_LOGGING_CATEGORY(lcTls, "qmessage.tls")
+Q_LOGGING_CATEGORY(lcUsers, "qmessage.users")
+Q_LOGGING_CATEGORY(lcSessions, "qmessage.sessions")
+Q_LOGGING_CATEGORY(lcHandoff, "qmessage.handoff")
+Q_LOGGING_CATEGORY(lcTrace, "qmessage.trace")
+Q_LOGGING_CATEGORY(lcCapture, "qmessage.capture")
+
+namespace {
+
+const int flushIntervalMs = 20;
+const qint64 repeatWindowMs = 1000;
+
+thread_local void *currentRing = nullptr;
+// Fields streamed into the message the calling thread is composing.
+thread_local QVector<LogField> pendingFields;
+
+const char *levelName(QtMsgType type)
+{
+    switch (type) {
+    case QtDebugMsg:
+        return "debug";
+    case QtInfoMsg:
+        return "info";
+    case QtWarningMsg:
+        return "warning";
+    case QtCriticalMsg:
+        return "critical";
+    case QtFatalMsg:
+        return "fatal";
+    }
+
+    return "unknown";
+}
+
+QByteArray quoted(const QString &value)
+{
+    QByteArray escaped = value.toUtf8();
+    escaped.replace('\\', "\\\\");
+    escaped.replace('"', "\\\"");
+    escaped.replace('\n', "\\n");
+
+    return '"' + escaped + '"';
+}
+
+QByteArray fieldText(const QJsonValue &value)
+{
+    switch (value.type()) {
+    case QJsonValue::String:
+        return quoted(value.toString());
+    case QJsonValue::Double:
+        return QByteArray::number(value.toDouble(), 'g', 17);
+    default:
+        return QByteArray();
+    }
+}
+
+}
+
+QDebug operator<<(QDebug debug, const LogField &field)
+{
+    // Qt's own handler knows nothing about fields, they become part of the message.
+    if (!Logger::instance()->isRunning()) {
+        {
+            QDebugStateSaver saver(debug);
+            debug.noquote().nospace() << field.key() << '=' << QString::fromUtf8(fieldText(field.value()));
+        }
+        return debug.maybeSpace();
+    }
+
+    pendingFields.append(field);
+
+    return debug;
+}
+
+// Single producer (the owning thread), single consumer (whoever holds m_writeMutex).
+struct Logger::Ring {
+    explicit Ring(size_t size) : records(size), mask(size - 1) {}
+
+    std::vector<Record> records;
+    const size_t mask;
+    std::atomic<size_t> head { 0 };
+    std::atomic<size_t> tail { 0 };
+    std::atomic<quint64> dropped { 0 };
+    int threadIndex = 0;
+
+    // Repeats are counted by the producer alone. The flusher only reads the atomics, to report
+    // what a producer which went quiet suppressed before it could queue the summary.
+    QHash<uint, Repeat> repeats;
+    QHash<uint, Record> firstRepeats;
+    quint64 windowSuppressed = 0;
+    std::atomic<qint64> windowStartMs { 0 };
+    std::atomic<quint64> suppressed { 0 };
+};
+
+Logger::Logger(QObject *parent) : QObject(parent), m_running(false)
+{
+}
+
+Logger::~Logger()
+{
+    stop();
+}
+
+Logger *Logger::instance()
+{
+    static Logger *logger = new Logger(qApp);
+    return logger;
+}
+
+void Logger::setFormat(Format format)
+{
+    m_format = format;
+}
+
+void Logger::setBufferSize(int recordsPerThread)
+{
+    // Rounded up to a power of two so that ring positions wrap with a mask.
+    int size = 64;
+    while (size < recordsPerThread && size < (1 << 24)) {
+        size <<= 1;
+    }
+    m_bufferSize = size;
+}
+
+void Logger::setRepeatLimit(int messagesPerSecond)
+{
+    m_repeatLimit = qMax(0, messagesPerSecond);
+}
+
+void Logger::setRepeatsByCallSite(bool enabled)
+{
+    m_repeatsByCallSite = enabled;
+}
+
+void Logger::setFilterRules(const QString &rules)
+{
+    QLoggingCategory::setFilterRules(rules);
+}
+
+bool Logger::watchFilterRulesFile(const QString &path)
+{
+    if (!QFile::exists(path)) {
+        qCWarning(lcServer) << "Log rules file" << path << "doesn't exist";
+        return false;
+    }
+
+    m_rulesFile = path;
+
+    if (!m_rulesWatcher) {
+        m_rulesWatcher = new QFileSystemWatcher(this);
+        connect(m_rulesWatcher, &QFileSystemWatcher::fileChanged, this, &Logger::onFilterRulesFileChanged);
+    }
+    m_rulesWatcher->addPath(path);
+
+    onFilterRulesFileChanged();
+
+    return true;
+}
+
+void Logger::onFilterRulesFileChanged()
+{
+    QFile file(m_rulesFile);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qCWarning(lcServer) << "Couldn't read log rules" << m_rulesFile << file.errorString();
+        return;
+    }
+
+    setFilterRules(QString::fromUtf8(file.readAll()));
+
+    // Editors usually replace the file, which drops it from the watcher.
+    if (!m_rulesWatcher->files().contains(m_rulesFile)) {
+        m_rulesWatcher->addPath(m_rulesFile);
+    }
+
+    qCInfo(lcServer) << "Applied log rules from" << m_rulesFile;
+}
+
+void Logger::start()
+{
+    if (m_running.exchange(true)) {
+        return;
+    }
+
+    m_flusher = std::thread(&Logger::flusherLoop, this);
+    m_previousHandler = qInstallMessageHandler(&Logger::messageHandler);
+}
+
+void Logger::stop()
+{
+    if (!m_running.exchange(false)) {
+        return;
+    }
+
+    qInstallMessageHandler(m_previousHandler);
+
+    m_wake.notify_one();
+    m_flusher.join();
+
+    drain();
+}
+
+bool Logger::isRunning() const
+{
+    return m_running.load(std::memory_order_relaxed);
+}
+
+void Logger::messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    Logger *logger = instance();
+    Ring *ring = logger->threadRing();
+
+    const qint64 timestampMs = QDateTime::currentMSecsSinceEpoch();
+
+    QVector<LogField> fields;
+    fields.swap(pendingFields);
+
+    if (!logger->allow(ring, type, context, message, timestampMs)) {
+        return;
+    }
+
+    Record record;
+    record.type = type;
+    record.category = context.category;
+    record.file = context.file;
+    record.line = context.line;
+    record.timestampMs = timestampMs;
+    record.message = message;
+    record.fields = std::move(fields);
+
+    // The process aborts right after a fatal message, so it is written synchronously.
+    if (type == QtFatalMsg) {
+        logger->drain();
+
+        std::lock_guard<std::mutex> lock(logger->m_writeMutex);
+        logger->write(ring->threadIndex, record);
+        std::fflush(stderr);
+
+        return;
+    }
+
+    logger->enqueue(ring, std::move(record));
+}
+
+Logger::Ring *Logger::threadRing()
+{
+    if (currentRing) {
+        return static_cast<Ring*>(currentRing);
+    }
+
+    auto ring = std::make_unique<Ring>(static_cast<size_t>(m_bufferSize));
+
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    ring->threadIndex = static_cast<int>(m_rings.size());
+    m_rings.push_back(std::move(ring));
+
+    currentRing = m_rings.back().get();
+
+    return m_rings.back().get();
+}
+
+bool Logger::allow(Ring *ring, QtMsgType type, const QMessageLogContext &context, const QString &message, qint64 timestampMs)
+{
+    if (m_repeatLimit <= 0 || type == QtFatalMsg) {
+        return true;
+    }
+
+    if (timestampMs - ring->windowStartMs.load(std::memory_order_relaxed) >= repeatWindowMs) {
+        summarizeRepeats(ring, timestampMs);
+    }
+
+    const uint key = m_repeatsByCallSite && context.file
+            ? qHash(QByteArray::fromRawData(context.file, static_cast<int>(qstrlen(context.file))), static_cast<uint>(context.line))
+            : qHash(message);
+
+    Repeat &repeat = ring->repeats[key];
+    if (++repeat.count <= m_repeatLimit) {
+        return true;
+    }
+
+    if (repeat.suppressed++ == 0) {
+        Record first;
+        first.type = type;
+        first.category = context.category;
+        first.file = context.file;
+        first.line = context.line;
+        first.message = message;
+        ring->firstRepeats.insert(key, first);
+    }
+
+    ++ring->windowSuppressed;
+    ring->suppressed.fetch_add(1, std::memory_order_relaxed);
+
+    return false;
+}
+
+// Runs on the producer, the summaries queue up behind the messages they follow.
+void Logger::summarizeRepeats(Ring *ring, qint64 timestampMs)
+{
+    // Whatever the flusher took meanwhile it has reported already, as a bare count.
+    const quint64 unreported = ring->suppressed.exchange(0, std::memory_order_relaxed);
+
+    if (unreported == ring->windowSuppressed) {
+        for (auto it = ring->repeats.cbegin(); it != ring->repeats.cend(); ++it) {
+            if (it.value().suppressed > 0) {
+                Record summary = ring->firstRepeats.value(it.key());
+                summary.timestampMs = timestampMs;
+                summary.message = QStringLiteral("Suppressed %1 repeats of: %2").arg(it.value().suppressed).arg(summary.message);
+                enqueue(ring, std::move(summary));
+            }
+        }
+    } else if (unreported > 0) {
+        enqueue(ring, suppressionNote(unreported, timestampMs));
+    }
+
+    ring->repeats.clear();
+    ring->firstRepeats.clear();
+    ring->windowSuppressed = 0;
+    ring->windowStartMs.store(timestampMs, std::memory_order_relaxed);
+}
+
+Logger::Record Logger::suppressionNote(quint64 count, qint64 timestampMs)
+{
+    Record note;
+    note.type = QtWarningMsg;
+    note.category = lcServer().categoryName();
+    note.timestampMs = timestampMs;
+    note.message = QStringLiteral("Suppressed %1 repeated records").arg(count);
+
+    return note;
+}
+
+void Logger::enqueue(Ring *ring, Record &&record)
+{
+    const size_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= ring->records.size()) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    ring->records[head & ring->mask] = std::move(record);
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void Logger::flusherLoop()
+{
+    while (m_running.load()) {
+        drain();
+
+        std::unique_lock<std::mutex> lock(m_wakeMutex);
+        m_wake.wait_for(lock, std::chrono::milliseconds(flushIntervalMs), [this]() {
+            return !m_running.load();
+        });
+    }
+}
+
+bool Logger::drain()
+{
+    std::vector<Ring*> rings;
+    {
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        rings.reserve(m_rings.size());
+        for (const auto &ring : m_rings) {
+            rings.push_back(ring.get());
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+
+    const qint64 nowMs = QDateTime::currentMSecsSinceEpoch();
+
+    bool wrote = false;
+    for (Ring *ring : rings) {
+        const size_t head = ring->head.load(std::memory_order_acquire);
+        size_t tail = ring->tail.load(std::memory_order_relaxed);
+
+        for (; tail != head; ++tail) {
+            Record &record = ring->records[tail & ring->mask];
+            write(ring->threadIndex, record);
+
+            // Let go of the message now rather than when the slot is reused.
+            record.message = QString();
+            record.fields = QVector<LogField>();
+            wrote = true;
+        }
+
+        ring->tail.store(tail, std::memory_order_release);
+
+        // A producer queues its summary with its next message after the window, one that went
+        // quiet is reported here. The texts stay with the producer, only the count is known.
+        if (ring->suppressed.load(std::memory_order_relaxed) > 0
+                && nowMs - ring->windowStartMs.load(std::memory_order_relaxed) >= repeatWindowMs) {
+            const quint64 suppressed = ring->suppressed.exchange(0, std::memory_order_relaxed);
+            if (suppressed > 0) {
+                write(ring->threadIndex, suppressionNote(suppressed, nowMs));
+                wrote = true;
+            }
+        }
+
+        const quint64 dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            Record note;
+            note.type = QtWarningMsg;
+            note.category = lcServer().categoryName();
+            note.timestampMs = QDateTime::currentMSecsSinceEpoch();
+            note.message = QStringLiteral("Log buffer full, dropped %1 records").arg(dropped);
+            write(ring->threadIndex, note);
+            wrote = true;
+        }
+    }
+
+    if (wrote) {
+        std::fflush(stderr);
+    }
+
+    return wrote;
+}
+
+void Logger::write(int threadIndex, const Record &record)
+{
+    QByteArray line;
+
+    if (m_format == JsonFormat) {
+        QJsonObject object;
+        object["ts"] = QDateTime::fromMSecsSinceEpoch(record.timestampMs).toString(Qt::ISODateWithMs);
+        object["level"] = QLatin1String(levelName(record.type));
+        object["category"] = QLatin1String(record.category ? record.category : "default");
+        object["thread"] = threadIndex;
+        if (record.file) {
+            object["source"] = QStringLiteral("%1:%2").arg(QLatin1String(record.file)).arg(record.line);
+        }
+        for (const LogField &field : record.fields) {
+            object[QLatin1String(field.key())] = field.value();
+        }
+        object["msg"] = record.message;
+
+        line = QJsonDocument(object).toJson(QJsonDocument::Compact);
+    } else {
+        line = "ts=" + QDateTime::fromMSecsSinceEpoch(record.timestampMs).toString(Qt::ISODateWithMs).toLatin1()
+                + " level=" + levelName(record.type)
+                + " category=" + (record.category ? record.category : "default")
+                + " thread=" + QByteArray::number(threadIndex);
+        if (record.file) {
+            line += " source=" + QByteArray(record.file) + ':' + QByteArray::number(record.line);
+        }
+        for (const LogField &field : record.fields) {
+            line += ' ' + QByteArray(field.key()) + '=' + fieldText(field.value());
+        }
+        line += " msg=" + quoted(record.message);
+    }
+
+    line += '\n';
+    std::fwrite(line.constData(), 1, static_cast<size_t>(line.size()), stderr);
+}
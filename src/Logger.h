@@ -0,0 +1,141 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <QDebug>
+#include <QJsonValue>
+#include <QLoggingCategory>
+#include <QObject>
+#include <QVector>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class QFileSystemWatcher;
+
+Q_DECLARE_LOGGING_CATEGORY(lcServer)
+Q_DECLARE_LOGGING_CATEGORY(lcHttp)
+Q_DECLARE_LOGGING_CATEGORY(lcTls)
+Q_DECLARE_LOGGING_CATEGORY(lcUsers)
+Q_DECLARE_LOGGING_CATEGORY(lcSessions)
+Q_DECLARE_LOGGING_CATEGORY(lcHandoff)
+Q_DECLARE_LOGGING_CATEGORY(lcTrace)
+Q_DECLARE_LOGGING_CATEGORY(lcCapture)
+
+// A key/value pair attached to the record being logged, written next to ts, level and the
+// other standard keys:
+//     qCInfo(lcUsers) << "Logged in" << LogField("user", user->id());
+// The key isn't copied and must be a string literal.
+class LogField {
+
+public:
+    LogField() = default;
+    LogField(const char *key, const QString &value) : m_key(key), m_value(value) {}
+    LogField(const char *key, qint64 value) : m_key(key), m_value(value) {}
+
+    const char *key() const { return m_key; }
+    const QJsonValue &value() const { return m_value; }
+
+private:
+    const char *m_key = nullptr;
+    QJsonValue m_value;
+};
+
+QDebug operator<<(QDebug debug, const LogField &field);
+
+// Takes log output off the calling thread. The Qt message handler stamps each record and
+// pushes it into a lock-free single-producer ring owned by the calling thread; a background
+// thread drains the rings and writes structured key/value lines to stderr. Disabled categories
+// never reach the handler, and repeats of the same message beyond the configured rate are
+// counted and dropped by the producer, which queues a summary once the second is over.
+class Logger : public QObject {
+
+    Q_OBJECT
+
+public:
+    enum Format {
+        TextFormat,
+        JsonFormat
+    };
+
+    static Logger *instance();
+    ~Logger() override;
+
+    void setFormat(Format format);
+    void setBufferSize(int recordsPerThread);
+    // Identical messages logged more often than this per second are suppressed, 0 disables the limit.
+    void setRepeatLimit(int messagesPerSecond);
+    // Counts messages from the same call site as repeats even when their text differs.
+    void setRepeatsByCallSite(bool enabled);
+
+    void setFilterRules(const QString &rules);
+    // Applies the rules in the file, and again whenever it changes.
+    bool watchFilterRulesFile(const QString &path);
+
+    void start();
+    // Writes out everything queued and gives stderr back to Qt.
+    void stop();
+    bool isRunning() const;
+
+private slots:
+    void onFilterRulesFileChanged();
+
+private:
+    struct Record {
+        QtMsgType type = QtDebugMsg;
+        const char *category = nullptr;
+        const char *file = nullptr;
+        int line = 0;
+        qint64 timestampMs = 0;
+        QString message;
+        QVector<LogField> fields;
+    };
+
+    struct Repeat {
+        int count = 0;
+        int suppressed = 0;
+    };
+
+    struct Ring;
+
+    explicit Logger(QObject *parent = nullptr);
+
+    static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message);
+
+    Ring *threadRing();
+    bool allow(Ring *ring, QtMsgType type, const QMessageLogContext &context, const QString &message, qint64 timestampMs);
+    void enqueue(Ring *ring, Record &&record);
+
+    void flusherLoop();
+    bool drain();
+    void summarizeRepeats(Ring *ring, qint64 timestampMs);
+    static Record suppressionNote(quint64 count, qint64 timestampMs);
+    void write(int threadIndex, const Record &record);
+
+private:
+    Format m_format = TextFormat;
+    int m_bufferSize = 4096;
+    int m_repeatLimit = 20;
+    bool m_repeatsByCallSite = false;
+
+    std::mutex m_ringsMutex;
+    std::vector<std::unique_ptr<Ring>> m_rings;
+
+    // Serializes writers to stderr, the flusher and synchronous fatal messages.
+    std::mutex m_writeMutex;
+
+    std::thread m_flusher;
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wake;
+    std::atomic<bool> m_running;
+
+    QtMessageHandler m_previousHandler = nullptr;
+
+    QFileSystemWatcher *m_rulesWatcher = nullptr;
+    QString m_rulesFile;
+};
+
+#endif // LOGGER_H
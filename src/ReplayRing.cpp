@@ -0,0 +1,82 @@
+#include "ReplayRing.h"
+
+int ReplayRing::s_capacity = 256;
+
+ReplayRing::ReplayRing(const QString &seqKey) : m_prefix(QStringLiteral("{\"") + seqKey + QStringLiteral("\":"))
+{
+}
+
+void ReplayRing::setCapacity(int capacity)
+{
+    s_capacity = qMax(0, capacity);
+}
+
+int ReplayRing::capacity()
+{
+    return s_capacity;
+}
+
+QString ReplayRing::append(const QString &event)
+{
+    ++m_lastSeq;
+
+    // Splice the sequence number in front of the other members instead of encoding the event again.
+    QString frame = m_prefix + QString::number(m_lastSeq);
+    if (event.size() > 2) {
+        frame += QLatin1Char(',');
+        frame += event.midRef(1);
+    } else {
+        frame += QLatin1Char('}');
+    }
+
+    if (s_capacity == 0) {
+        return frame;
+    }
+
+    if (m_frames.size() != s_capacity) {
+        m_frames.resize(s_capacity);
+        m_next = 0;
+        m_count = 0;
+    }
+
+    m_frames[m_next] = frame;
+    m_next = (m_next + 1) % s_capacity;
+    m_count = qMin(m_count + 1, s_capacity);
+
+    return frame;
+}
+
+quint64 ReplayRing::lastSeq() const
+{
+    return m_lastSeq;
+}
+
+bool ReplayRing::covers(quint64 lastSeen) const
+{
+    return lastSeen <= m_lastSeq && m_lastSeq - lastSeen <= static_cast<quint64>(m_count);
+}
+
+QVector<QString> ReplayRing::since(quint64 lastSeen) const
+{
+    QVector<QString> frames;
+    if (!covers(lastSeen)) {
+        return frames;
+    }
+
+    const int missed = static_cast<int>(m_lastSeq - lastSeen);
+    frames.reserve(missed);
+
+    const int size = m_frames.size();
+    for (int i = missed; i > 0; --i) {
+        frames.append(m_frames[(m_next - i + size) % size]);
+    }
+
+    return frames;
+}
+
+void ReplayRing::clear()
+{
+    m_frames.clear();
+    m_next = 0;
+    m_count = 0;
+}
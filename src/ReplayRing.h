@@ -0,0 +1,40 @@
+#ifndef REPLAYRING_H
+#define REPLAYRING_H
+
+#include <QString>
+#include <QVector>
+
+// Numbers the events of one stream (a user's session, a room) and keeps the most recent ones,
+// so a client that reconnects with the last sequence number it saw can be sent exactly the
+// events it missed.
+class ReplayRing
+{
+public:
+    // seqKey names the member carrying the sequence number in the frames.
+    explicit ReplayRing(const QString &seqKey = QStringLiteral("seq"));
+
+    static void setCapacity(int capacity);
+    static int capacity();
+
+    // Stamps the encoded event object with the next sequence number and keeps the frame.
+    QString append(const QString &event);
+
+    quint64 lastSeq() const;
+    // Whether every event after lastSeen is still held.
+    bool covers(quint64 lastSeen) const;
+    QVector<QString> since(quint64 lastSeen) const;
+
+    // Forgets the held events, sequence numbers keep counting up.
+    void clear();
+
+private:
+    static int s_capacity;
+
+    QString m_prefix;
+    QVector<QString> m_frames;
+    int m_next = 0;
+    int m_count = 0;
+    quint64 m_lastSeq = 0;
+};
+
+#endif // REPLAYRING_H
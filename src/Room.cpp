@@ -0,0 +1,55 @@
+#include "Room.h"
+
+Room::Room(const QString &id, const QString &name, User *owner, QObject *parent)
+    : QObject{parent}
+    , m_id(id)
+    , m_name(name)
+    , m_owner(owner)
+{
+
+}
+
+QString Room::id() const
+{
+    return m_id;
+}
+
+QString Room::name() const
+{
+    return m_name;
+}
+
+User *Room::owner() const
+{
+    return m_owner;
+}
+
+const QSet<User *> &Room::members() const
+{
+    return m_members;
+}
+
+bool Room::isMember(User *user) const
+{
+    return m_members.contains(user);
+}
+
+bool Room::addMember(User *user)
+{
+    if (!user || m_members.contains(user)) {
+        return false;
+    }
+
+    m_members.insert(user);
+    return true;
+}
+
+bool Room::removeMember(User *user)
+{
+    return m_members.remove(user);
+}
+
+ReplayRing &Room::replayRing()
+{
+    return m_replayRing;
+}
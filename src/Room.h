@@ -0,0 +1,39 @@
+#ifndef ROOM_H
+#define ROOM_H
+
+#include "ReplayRing.h"
+
+#include <QObject>
+#include <QSet>
+
+class User;
+
+class Room : public QObject {
+    Q_OBJECT
+
+public:
+    explicit Room(const QString &id, const QString &name, User *owner, QObject* parent = nullptr);
+
+    QString id() const;
+    QString name() const;
+    User *owner() const;
+
+    const QSet<User *> &members() const;
+    bool isMember(User *user) const;
+
+    bool addMember(User *user);
+    bool removeMember(User *user);
+
+    // Room events are numbered per room, so every member gets the same text.
+    ReplayRing &replayRing();
+
+private:
+    QString m_id = "";
+    QString m_name = "";
+    User* m_owner = nullptr;
+
+    QSet<User*> m_members;
+    ReplayRing m_replayRing { QStringLiteral("roomSeq") };
+};
+
+#endif // ROOM_H
@@ -0,0 +1,89 @@
+#include "Room.h"
+#include "RoomManager.h"
+
+#include <QRandomGenerator>
+
+RoomManager::RoomManager(QObject *parent) : QObject(parent)
+{
+}
+
+Room *RoomManager::createRoom(const QString &name, User *owner)
+{
+    if (name.isEmpty() || !owner || m_roomsByName.contains(name.toLower())) {
+        return nullptr;
+    }
+
+    Room *room = new Room(generateUniqueID(), name, owner, this);
+    m_roomsById.insert(room->id(), room);
+    m_roomsByName.insert(name.toLower(), room);
+
+    joinRoom(room, owner);
+
+    return room;
+}
+
+Room *RoomManager::findRoomById(const QString &id) const
+{
+    return m_roomsById.value(id, nullptr);
+}
+
+Room *RoomManager::findRoomByName(const QString &name) const
+{
+    return m_roomsByName.value(name.toLower(), nullptr);
+}
+
+bool RoomManager::joinRoom(Room *room, User *user)
+{
+    if (!room || !room->addMember(user)) {
+        return false;
+    }
+
+    m_roomsByUser[user].insert(room);
+    return true;
+}
+
+bool RoomManager::leaveRoom(Room *room, User *user)
+{
+    if (!room || !room->removeMember(user)) {
+        return false;
+    }
+
+    auto userRooms = m_roomsByUser.find(user);
+    if (userRooms != m_roomsByUser.end()) {
+        userRooms->remove(room);
+        if (userRooms->isEmpty()) {
+            m_roomsByUser.erase(userRooms);
+        }
+    }
+
+    if (room->members().isEmpty()) {
+        m_roomsById.remove(room->id());
+        m_roomsByName.remove(room->name().toLower());
+        room->deleteLater();
+    }
+
+    return true;
+}
+
+QList<Room *> RoomManager::roomsOfUser(User *user) const
+{
+    return m_roomsByUser.value(user).values();
+}
+
+QString RoomManager::generateUniqueID()
+{
+    const QString chars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    const int idLength = 6;
+
+    QString id;
+    for (int i = 0; i < idLength; ++i) {
+        int index = QRandomGenerator::global()->bounded(static_cast<int>(chars.length()));
+        id.append(chars.at(index));
+    }
+
+    if (m_roomsById.contains(id)) {
+        return generateUniqueID();
+    }
+
+    return id;
+}
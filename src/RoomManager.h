@@ -0,0 +1,39 @@
+#ifndef ROOMMANAGER_H
+#define ROOMMANAGER_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+
+class Room;
+class User;
+
+class RoomManager : public QObject {
+
+    Q_OBJECT
+
+public:
+    explicit RoomManager(QObject *parent = nullptr);
+
+    Room *createRoom(const QString &name, User *owner);
+
+    Room *findRoomById(const QString &id) const;
+    Room *findRoomByName(const QString &name) const;
+
+    bool joinRoom(Room *room, User *user);
+    bool leaveRoom(Room *room, User *user);
+
+    QList<Room *> roomsOfUser(User *user) const;
+
+private:
+    QString generateUniqueID();
+
+private:
+    // Indexes kept in sync by joinRoom/leaveRoom, so neither membership checks nor
+    // per-user room listings need to scan every room.
+    QHash<QString, Room*> m_roomsById;
+    QHash<QString, Room*> m_roomsByName;
+    QHash<User*, QSet<Room*>> m_roomsByUser;
+};
+
+#endif // ROOMMANAGER_H
@@ -0,0 +1,350 @@
+#include "SessionHandoff.h"
+#include "Logger.h"
+#include "UserManager.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QtEndian>
+
+#include <algorithm>
+#include <iterator>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char handoffMagic[4] = { 'Q', 'M', 'S', 'H' };
+const quint32 handoffVersion = 2;
+const int handoffTimeoutSeconds = 5;
+
+const char readyMessage = 'R';
+const char doneMessage = 'D';
+
+struct HandoffHeader {
+    char magic[4];
+    quint32 version;
+    // Bit n set means the descriptor for SessionHandoff::Listener n is attached, in listener order.
+    quint32 listenerMask;
+};
+
+#ifdef Q_OS_UNIX
+bool readFully(int fd, char *data, size_t size)
+{
+    while (size > 0) {
+        const ssize_t received = ::recv(fd, data, size, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (received <= 0) {
+            return false;
+        }
+
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+
+    return true;
+}
+
+bool writeFully(int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        const ssize_t sent = ::send(fd, data, size, 0);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (sent <= 0) {
+            return false;
+        }
+
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+
+    return true;
+}
+#endif
+
+}
+
+SessionHandoff::SessionHandoff(QObject *parent) : QObject(parent)
+{
+    std::fill(std::begin(m_descriptors), std::end(m_descriptors), -1);
+    std::fill(std::begin(m_inheritedDescriptors), std::end(m_inheritedDescriptors), -1);
+}
+
+bool SessionHandoff::takeOver(const QString &path)
+{
+#ifdef Q_OS_UNIX
+    const QByteArray encodedPath = QFile::encodeName(path);
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (encodedPath.size() >= static_cast<int>(sizeof(address.sun_path))) {
+        qCWarning(lcHandoff) << "Upgrade socket path is too long:" << path;
+        return false;
+    }
+    std::memcpy(address.sun_path, encodedPath.constData(), encodedPath.size());
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Nobody listening means there is no previous process, which is the normal cold start.
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    timeval timeout;
+    timeout.tv_sec = handoffTimeoutSeconds;
+    timeout.tv_usec = 0;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    HandoffHeader header;
+    iovec headerVector;
+    headerVector.iov_base = &header;
+    headerVector.iov_len = sizeof(header);
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * ListenerCount)];
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &headerVector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received = -1;
+    do {
+        received = ::recvmsg(fd, &message, 0);
+    } while (received < 0 && errno == EINTR);
+
+    int descriptors[ListenerCount];
+    int descriptorCount = 0;
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            const int count = static_cast<int>((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            for (int i = 0; i < count && descriptorCount < ListenerCount; ++i) {
+                std::memcpy(&descriptors[descriptorCount++], CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            }
+        }
+    }
+
+    const auto fail = [&](const char *reason) {
+        qCWarning(lcHandoff) << "Taking over from the previous process failed:" << reason;
+        for (int i = 0; i < descriptorCount; ++i) {
+            ::close(descriptors[i]);
+        }
+        ::close(fd);
+
+        return false;
+    };
+
+    if (received != static_cast<ssize_t>(sizeof(header)) || (message.msg_flags & MSG_CTRUNC)) {
+        return fail("incomplete handoff header");
+    }
+
+    if (std::memcmp(header.magic, handoffMagic, sizeof(handoffMagic)) != 0 || header.version != handoffVersion) {
+        return fail("incompatible handoff protocol");
+    }
+
+    int expectedCount = 0;
+    for (int listener = 0; listener < ListenerCount; ++listener) {
+        if (header.listenerMask & (1u << listener)) {
+            ++expectedCount;
+        }
+    }
+
+    if (expectedCount != descriptorCount) {
+        return fail("listener descriptors missing");
+    }
+
+    // The previous process stops accepting once it reads this and drains its connections. It
+    // releases the upgrade socket path and exports the session table only once its in-flight
+    // requests are done, so the table includes them and we can listen on the path afterwards.
+    char done = 0;
+    if (!writeFully(fd, &readyMessage, 1) || !readFully(fd, &done, 1) || done != doneMessage) {
+        return fail("previous process did not confirm the handoff");
+    }
+
+    quint32 sessionsSize = 0;
+    if (!readFully(fd, reinterpret_cast<char *>(&sessionsSize), sizeof(sessionsSize))) {
+        return fail("session table missing");
+    }
+
+    QByteArray sessions(static_cast<int>(qFromBigEndian(sessionsSize)), Qt::Uninitialized);
+    if (!readFully(fd, sessions.data(), static_cast<size_t>(sessions.size()))) {
+        return fail("session table truncated");
+    }
+
+    ::close(fd);
+
+    int next = 0;
+    for (int listener = 0; listener < ListenerCount; ++listener) {
+        if (header.listenerMask & (1u << listener)) {
+            m_inheritedDescriptors[listener] = descriptors[next++];
+        }
+    }
+    m_inheritedSessions = sessions;
+
+    qCDebug(lcHandoff) << "Took over" << descriptorCount << "listening sockets from the previous process";
+
+    return true;
+#else
+    Q_UNUSED(path)
+    qCWarning(lcHandoff) << "Taking over listening sockets is only supported on Unix systems.";
+
+    return false;
+#endif
+}
+
+qintptr SessionHandoff::inheritedDescriptor(Listener listener) const
+{
+    return m_inheritedDescriptors[listener];
+}
+
+QByteArray SessionHandoff::inheritedSessions() const
+{
+    return m_inheritedSessions;
+}
+
+bool SessionHandoff::listen(const QString &path, UserManager *userManager)
+{
+    m_userManager = userManager;
+
+    if (!m_server) {
+        m_server = new QLocalServer(this);
+        m_server->setSocketOptions(QLocalServer::UserAccessOption);
+        connect(m_server, &QLocalServer::newConnection, this, &SessionHandoff::onNewConnection);
+    }
+
+    QLocalServer::removeServer(path);
+    if (!m_server->listen(path)) {
+        qCWarning(lcHandoff) << "Couldn't listen on upgrade socket" << path << m_server->errorString();
+        return false;
+    }
+
+    qCDebug(lcHandoff) << "Upgrade socket listening on" << path;
+
+    return true;
+}
+
+void SessionHandoff::setDescriptor(Listener listener, qintptr descriptor)
+{
+    m_descriptors[listener] = descriptor;
+}
+
+void SessionHandoff::onNewConnection()
+{
+    QLocalSocket *socket = m_server->nextPendingConnection();
+    if (!socket) {
+        return;
+    }
+
+    connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+
+#ifdef Q_OS_UNIX
+    HandoffHeader header;
+    std::memcpy(header.magic, handoffMagic, sizeof(handoffMagic));
+    header.version = handoffVersion;
+    header.listenerMask = 0;
+
+    int descriptors[ListenerCount];
+    int descriptorCount = 0;
+    for (int listener = 0; listener < ListenerCount; ++listener) {
+        if (m_descriptors[listener] >= 0) {
+            header.listenerMask |= 1u << listener;
+            descriptors[descriptorCount++] = static_cast<int>(m_descriptors[listener]);
+        }
+    }
+
+    iovec headerVector;
+    headerVector.iov_base = &header;
+    headerVector.iov_len = sizeof(header);
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * ListenerCount)];
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &headerVector;
+    message.msg_iovlen = 1;
+
+    if (descriptorCount > 0) {
+        std::memset(control, 0, sizeof(control));
+        message.msg_control = control;
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * descriptorCount);
+
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * descriptorCount);
+        std::memcpy(CMSG_DATA(cmsg), descriptors, sizeof(int) * descriptorCount);
+    }
+
+    ssize_t sent = -1;
+    do {
+        sent = ::sendmsg(static_cast<int>(socket->socketDescriptor()), &message, 0);
+    } while (sent < 0 && errno == EINTR);
+
+    if (sent != static_cast<ssize_t>(sizeof(header))) {
+        qCWarning(lcHandoff) << "Couldn't hand listening sockets over:" << std::strerror(errno);
+        socket->abort();
+        return;
+    }
+
+    connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+        onReadyRead(socket);
+    });
+
+    qCDebug(lcHandoff) << "New process requested a handoff, sent" << descriptorCount << "listening sockets";
+#else
+    socket->abort();
+#endif
+}
+
+void SessionHandoff::completeHandoff()
+{
+    if (!m_pendingSocket) {
+        return;
+    }
+
+    // Closing the server removes the socket file, the new process may only listen on it afterwards.
+    m_server->close();
+
+    const QByteArray sessions = m_userManager ? m_userManager->exportSessions() : QByteArray();
+    const quint32 sessionsSize = qToBigEndian(static_cast<quint32>(sessions.size()));
+
+    m_pendingSocket->write(&doneMessage, 1);
+    m_pendingSocket->write(reinterpret_cast<const char *>(&sessionsSize), sizeof(sessionsSize));
+    m_pendingSocket->write(sessions);
+    m_pendingSocket->flush();
+    m_pendingSocket->disconnectFromServer();
+    m_pendingSocket = nullptr;
+
+    qCDebug(lcHandoff) << "Handed sessions over to the new process" << LogField("bytes", sessions.size());
+}
+
+void SessionHandoff::onReadyRead(QLocalSocket *socket)
+{
+    if (m_pendingSocket || socket->read(1) != QByteArray(1, readyMessage)) {
+        socket->abort();
+        return;
+    }
+
+    m_pendingSocket = socket;
+
+    emit takeOverStarted();
+}
@@ -0,0 +1,62 @@
+#ifndef SESSIONHANDOFF_H
+#define SESSIONHANDOFF_H
+
+#include <QObject>
+#include <QPointer>
+
+class QLocalServer;
+class QLocalSocket;
+class UserManager;
+
+// Hands the listening sockets and the session table of a running server over to a freshly
+// started one. The old process keeps an upgrade socket open; a new process started with the
+// same path receives duplicates of the listening descriptors through SCM_RIGHTS, so the ports
+// never stop accepting, then the old process stops accepting and drains its connections. The
+// session table is only sent once the drain has let in-flight requests finish, so that nothing
+// they changed is lost; the new process waits for it before serving.
+class SessionHandoff : public QObject {
+
+    Q_OBJECT
+
+public:
+    enum Listener {
+        ChatListener,
+        HttpListener,
+        HttpsListener,
+
+        ListenerCount
+    };
+
+    explicit SessionHandoff(QObject *parent = nullptr);
+
+    // New process side, blocks until the previous process handed everything over or failed.
+    bool takeOver(const QString &path);
+    qintptr inheritedDescriptor(Listener listener) const;
+    QByteArray inheritedSessions() const;
+
+    // Old process side, offers the given descriptors and the sessions of userManager to the next process.
+    bool listen(const QString &path, UserManager *userManager);
+    void setDescriptor(Listener listener, qintptr descriptor);
+    // Sends the current session table and lets the new process continue.
+    void completeHandoff();
+
+signals:
+    // The new process holds the listening sockets, stop accepting and call completeHandoff() once drained.
+    void takeOverStarted();
+
+private slots:
+    void onNewConnection();
+
+private:
+    void onReadyRead(QLocalSocket *socket);
+
+private:
+    QLocalServer *m_server = nullptr;
+    UserManager *m_userManager = nullptr;
+    QPointer<QLocalSocket> m_pendingSocket;
+    qintptr m_descriptors[ListenerCount];
+    qintptr m_inheritedDescriptors[ListenerCount];
+    QByteArray m_inheritedSessions;
+};
+
+#endif // SESSIONHANDOFF_H
@@ -0,0 +1,393 @@
+#include "SessionStore.h"
+#include "Logger.h"
+#include "User.h"
+#include "UserManager.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QTimer>
+#include <QtEndian>
+
+#include <cstring>
+
+namespace {
+
+const char snapshotMagic[4] = { 'Q', 'M', 'S', 'S' };
+const quint32 snapshotVersion = 1;
+const int headerSize = sizeof(snapshotMagic) + sizeof(quint32);
+
+const int defaultSnapshotIntervalSeconds = 60;
+
+// Well below the 10 minute idle timeout, a crash loses at most this much of a user's activity.
+const qint64 activityJournalIntervalMs = 10000;
+
+}
+
+SessionStore::SessionStore(UserManager *userManager, QObject *parent)
+    : QObject(parent)
+    , m_userManager(userManager)
+    , m_snapshotTimer(new QTimer(this))
+    , m_writer(new QThreadPool(this))
+{
+    m_writer->setMaxThreadCount(1);
+
+    m_snapshotTimer->setInterval(defaultSnapshotIntervalSeconds * 1000);
+    connect(m_snapshotTimer, &QTimer::timeout, this, &SessionStore::snapshotInBackground);
+}
+
+SessionStore::~SessionStore()
+{
+    // The worker reports back to this object.
+    m_writer->waitForDone();
+}
+
+void SessionStore::setPath(const QString &path)
+{
+    m_path = path;
+}
+
+void SessionStore::setSnapshotInterval(int seconds)
+{
+    m_snapshotTimer->setInterval(qMax(1, seconds) * 1000);
+}
+
+void SessionStore::setJournalEnabled(bool enabled)
+{
+    m_journalEnabled = enabled;
+}
+
+bool SessionStore::isEnabled() const
+{
+    return !m_path.isEmpty();
+}
+
+bool SessionStore::load()
+{
+    if (!isEnabled()) {
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int restored = 0;
+
+    QFile snapshotFile(m_path);
+    if (snapshotFile.open(QIODevice::ReadOnly) && snapshotFile.size() >= headerSize) {
+        const qint64 size = snapshotFile.size();
+        const uchar *data = snapshotFile.map(0, size);
+
+        if (!data) {
+            qCWarning(lcSessions) << "Couldn't map session snapshot" << m_path << snapshotFile.errorString();
+        } else if (std::memcmp(data, snapshotMagic, sizeof(snapshotMagic)) != 0
+                   || qFromLittleEndian<quint32>(data + sizeof(snapshotMagic)) != snapshotVersion) {
+            qCWarning(lcSessions) << "Ignoring session snapshot with unknown format" << m_path;
+        } else {
+            bool complete = false;
+            restored += decode(reinterpret_cast<const char *>(data) + headerSize, size - headerSize, m_userManager, &complete);
+            if (!complete) {
+                qCWarning(lcSessions) << "Session snapshot" << m_path << "is corrupted, restored sessions up to the damaged record";
+            }
+        }
+
+        snapshotFile.close();
+    }
+
+    if (m_journalEnabled) {
+        QFile journalFile(journalPath());
+        if (journalFile.open(QIODevice::ReadOnly) && journalFile.size() > 0) {
+            const uchar *data = journalFile.map(0, journalFile.size());
+            if (data) {
+                // A record cut short by a crash is expected at the journal's end.
+                restored += decode(reinterpret_cast<const char *>(data), journalFile.size(), m_userManager);
+            }
+            journalFile.close();
+        }
+
+        openJournal();
+    }
+
+    m_snapshotTimer->start();
+
+    qCDebug(lcSessions) << "Restored session records" << LogField("records", restored) << LogField("ms", timer.elapsed());
+
+    return true;
+}
+
+void SessionStore::close()
+{
+    m_snapshotTimer->stop();
+    m_writer->waitForDone();
+    m_journal.close();
+    m_journaledActivity.clear();
+    m_path.clear();
+}
+
+bool SessionStore::snapshot()
+{
+    if (!isEnabled()) {
+        return false;
+    }
+
+    // A background write still on its way would otherwise commit an older table over this one.
+    m_writer->waitForDone();
+    m_snapshotInFlight = false;
+    m_journalSinceSnapshot.clear();
+
+    QString error;
+    if (!writeSnapshot(m_path, snapshotData(), &error)) {
+        qCWarning(lcSessions) << "Couldn't write session snapshot" << m_path << error;
+        emit snapshotWritten(false);
+        return false;
+    }
+
+    // Everything in the journal is part of the snapshot now. Should we crash before this point,
+    // replaying the journal again on top of the new snapshot is harmless.
+    if (m_journal.isOpen()) {
+        m_journal.resize(0);
+    }
+
+    emit snapshotWritten(true);
+    return true;
+}
+
+void SessionStore::snapshotInBackground()
+{
+    if (!isEnabled() || m_snapshotInFlight) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Serializing stays here, the users belong to this thread. Only the disk sees the worker.
+    const QByteArray data = snapshotData();
+    const QString path = m_path;
+
+    qCDebug(lcSessions) << "Serialized session snapshot" << LogField("bytes", data.size()) << LogField("ms", timer.elapsed());
+
+    m_snapshotInFlight = true;
+    m_journalSinceSnapshot.clear();
+
+    m_writer->start([this, path, data]() {
+        QString error;
+        const bool written = writeSnapshot(path, data, &error);
+
+        QMetaObject::invokeMethod(this, [this, written, error]() {
+            finishSnapshot(written, error);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void SessionStore::finishSnapshot(bool written, const QString &error)
+{
+    // A synchronous snapshot was written meanwhile and took care of the journal.
+    if (!m_snapshotInFlight) {
+        return;
+    }
+
+    m_snapshotInFlight = false;
+
+    if (!written) {
+        // The journal still has everything since the last snapshot which made it.
+        qCWarning(lcSessions) << "Couldn't write session snapshot" << m_path << error;
+        m_journalSinceSnapshot.clear();
+        emit snapshotWritten(false);
+        return;
+    }
+
+    // Only what was journaled before serializing is in the snapshot, the rest stays.
+    if (m_journal.isOpen()) {
+        m_journal.resize(0);
+        m_journal.write(m_journalSinceSnapshot);
+        m_journal.flush();
+    }
+    m_journalSinceSnapshot.clear();
+
+    emit snapshotWritten(true);
+}
+
+QByteArray SessionStore::snapshotData() const
+{
+    QByteArray buffer;
+    buffer.append(snapshotMagic, sizeof(snapshotMagic));
+
+    const quint32 version = qToLittleEndian(snapshotVersion);
+    buffer.append(reinterpret_cast<const char *>(&version), sizeof(version));
+
+    buffer.append(encode(m_userManager->users()));
+
+    return buffer;
+}
+
+bool SessionStore::writeSnapshot(const QString &path, const QByteArray &data, QString *error)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        *error = file.errorString();
+        return false;
+    }
+
+    if (file.write(data) != data.size() || !file.commit()) {
+        *error = file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+void SessionStore::journal(User *user)
+{
+    if (!m_journal.isOpen() || !user) {
+        return;
+    }
+
+    QByteArray record;
+    appendRecord(record, user);
+
+    m_journal.write(record);
+    m_journal.flush();
+
+    if (m_snapshotInFlight) {
+        m_journalSinceSnapshot.append(record);
+    }
+
+    m_journaledActivity.insert(user, user->lastActive().toMSecsSinceEpoch());
+}
+
+void SessionStore::journalActivity(User *user)
+{
+    if (!m_journal.isOpen() || !user || user->token().isEmpty()) {
+        return;
+    }
+
+    const qint64 lastActive = user->lastActive().toMSecsSinceEpoch();
+    const auto journaled = m_journaledActivity.constFind(user);
+    if (journaled != m_journaledActivity.cend() && lastActive - *journaled < activityJournalIntervalMs) {
+        return;
+    }
+
+    journal(user);
+}
+
+void SessionStore::journalRecords(const QByteArray &records)
+{
+    if (records.isEmpty() || !isEnabled()) {
+        return;
+    }
+
+    // Same record format, replaying the journal applies them again. Without a journal only a
+    // snapshot keeps them.
+    if (m_journal.isOpen()) {
+        m_journal.write(records);
+        m_journal.flush();
+
+        if (m_snapshotInFlight) {
+            m_journalSinceSnapshot.append(records);
+        }
+    } else {
+        snapshot();
+    }
+}
+
+QByteArray SessionStore::encode(const QList<User *> &users)
+{
+    QByteArray buffer;
+    for (User* user : users) {
+        if (!user->token().isEmpty()) {
+            appendRecord(buffer, user);
+        }
+    }
+
+    return buffer;
+}
+
+int SessionStore::decode(const char *data, qint64 size, UserManager *userManager, bool *complete)
+{
+    // Record layout, little endian: u8 id length, id, u8 token length, token,
+    // i64 last activity in ms since epoch, u32 public key length, public key.
+    // An empty token revokes the session of that user.
+    const char *end = data + size;
+    int count = 0;
+
+    if (complete) {
+        *complete = false;
+    }
+
+    while (data < end) {
+        const auto take = [&](qint64 length) -> const char * {
+            if (end - data < length) {
+                return nullptr;
+            }
+
+            const char *field = data;
+            data += length;
+            return field;
+        };
+
+        const char *idLength = take(1);
+        const char *id = idLength ? take(static_cast<uchar>(*idLength)) : nullptr;
+        const char *tokenLength = id ? take(1) : nullptr;
+        const char *token = tokenLength ? take(static_cast<uchar>(*tokenLength)) : nullptr;
+        const char *lastActive = token ? take(sizeof(qint64)) : nullptr;
+        const char *keyLength = lastActive ? take(sizeof(quint32)) : nullptr;
+        const char *key = keyLength ? take(qFromLittleEndian<quint32>(keyLength)) : nullptr;
+
+        if (!key) {
+            return count;
+        }
+
+        User *user = userManager->findUserById(QString::fromUtf8(id, static_cast<uchar>(*idLength)));
+        if (user) {
+            const int tokenSize = static_cast<uchar>(*tokenLength);
+            if (tokenSize == 0) {
+                user->setToken("");
+            } else {
+                user->setToken(QString::fromLatin1(token, tokenSize));
+                user->setLastActive(QDateTime::fromMSecsSinceEpoch(qFromLittleEndian<qint64>(lastActive)));
+                user->setPublicKey(QString::fromUtf8(key, static_cast<int>(qFromLittleEndian<quint32>(keyLength))));
+            }
+        }
+
+        ++count;
+    }
+
+    if (complete) {
+        *complete = true;
+    }
+
+    return count;
+}
+
+void SessionStore::appendRecord(QByteArray &buffer, User *user)
+{
+    const QByteArray id = user->id().toUtf8();
+    const QByteArray token = user->token().toLatin1();
+    const QByteArray key = user->publicKey().toUtf8();
+
+    const qint64 lastActive = qToLittleEndian<qint64>(user->lastActive().toMSecsSinceEpoch());
+    const quint32 keyLength = qToLittleEndian<quint32>(static_cast<quint32>(key.size()));
+
+    buffer.append(static_cast<char>(qMin(id.size(), 255)));
+    buffer.append(id.constData(), qMin(id.size(), 255));
+    buffer.append(static_cast<char>(qMin(token.size(), 255)));
+    buffer.append(token.constData(), qMin(token.size(), 255));
+    buffer.append(reinterpret_cast<const char *>(&lastActive), sizeof(lastActive));
+    buffer.append(reinterpret_cast<const char *>(&keyLength), sizeof(keyLength));
+    buffer.append(key);
+}
+
+QString SessionStore::journalPath() const
+{
+    return m_path + ".journal";
+}
+
+void SessionStore::openJournal()
+{
+    m_journal.setFileName(journalPath());
+    if (!m_journal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCWarning(lcSessions) << "Couldn't open session journal" << journalPath() << m_journal.errorString();
+    }
+}
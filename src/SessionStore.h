@@ -0,0 +1,77 @@
+#ifndef SESSIONSTORE_H
+#define SESSIONSTORE_H
+
+#include <QFile>
+#include <QHash>
+#include <QObject>
+
+class QThreadPool;
+class QTimer;
+class User;
+class UserManager;
+
+// Keeps sessions (token, last activity and public key) across restarts. A compact snapshot is
+// written periodically and memory-mapped on startup; optionally every token change between
+// snapshots is appended to a journal, which is replayed on top of the snapshot. Activity only
+// reaches the journal every activityJournalIntervalMs per user, it is only needed for the
+// idle timeout and would otherwise add a record per request. Periodic snapshots are serialized
+// on the calling thread, which owns the users, and written to disk by a worker thread.
+class SessionStore : public QObject {
+
+    Q_OBJECT
+
+public:
+    explicit SessionStore(UserManager *userManager, QObject *parent = nullptr);
+    ~SessionStore();
+
+    void setPath(const QString &path);
+    void setSnapshotInterval(int seconds);
+    void setJournalEnabled(bool enabled);
+
+    bool isEnabled() const;
+
+    bool load();
+    // Stops persisting, used once another process took over the session table.
+    void close();
+
+    // Persists records applied from elsewhere, e.g. the session table handed over by a previous process.
+    void journalRecords(const QByteArray &records);
+
+    static QByteArray encode(const QList<User *> &users);
+    static int decode(const char *data, qint64 size, UserManager *userManager, bool *complete = nullptr);
+
+signals:
+    void snapshotWritten(bool written);
+
+public slots:
+    // Writes the snapshot before returning, used on shutdown.
+    bool snapshot();
+    // Hands the write to the worker thread, does nothing while the previous one is still running.
+    void snapshotInBackground();
+    void journal(User *user);
+    void journalActivity(User *user);
+
+private:
+    static void appendRecord(QByteArray &buffer, User *user);
+    QByteArray snapshotData() const;
+    static bool writeSnapshot(const QString &path, const QByteArray &data, QString *error);
+    void finishSnapshot(bool written, const QString &error);
+
+    QString journalPath() const;
+    void openJournal();
+
+private:
+    UserManager *m_userManager = nullptr;
+    QTimer *m_snapshotTimer = nullptr;
+    QThreadPool *m_writer = nullptr;
+    bool m_snapshotInFlight = false;
+    // Journal records written while a background snapshot is on its way, they aren't part of it.
+    QByteArray m_journalSinceSnapshot;
+    QString m_path = "";
+    bool m_journalEnabled = false;
+    QFile m_journal;
+    // Last activity written for each user, in ms since the epoch.
+    QHash<User*, qint64> m_journaledActivity;
+};
+
+#endif // SESSIONSTORE_H
@@ -0,0 +1,93 @@
+#include "Logger.h"
+#include "TokenRevocationList.h"
+#include "Tracer.h"
+
+#include <QDateTime>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTimer>
+#include <QVariant>
+
+namespace {
+
+const int reloadIntervalMs = 10000;
+
+}
+
+TokenRevocationList::TokenRevocationList(QObject *parent)
+    : QObject(parent)
+    , m_reloadTimer(new QTimer(this))
+{
+    QSqlQuery query;
+    query.exec("CREATE TABLE IF NOT EXISTS revoked_sessions (user TEXT PRIMARY KEY, issued_before INTEGER, expires INTEGER)");
+
+    connect(m_reloadTimer, &QTimer::timeout, this, &TokenRevocationList::reload);
+    m_reloadTimer->start(reloadIntervalMs);
+
+    reload();
+}
+
+void TokenRevocationList::revoke(const QString &userId, qint64 issuedBefore, qint64 expiresAt)
+{
+    TraceSpan span("revokeSessions", "sql");
+
+    Revocation &revocation = m_revoked[userId];
+    revocation.issuedBefore = qMax(revocation.issuedBefore, issuedBefore);
+    revocation.expiresAt = qMax(revocation.expiresAt, expiresAt);
+
+    // Another instance may have moved the mark further meanwhile, never move it back.
+    QSqlQuery query;
+    query.prepare("INSERT OR REPLACE INTO revoked_sessions (user, issued_before, expires) "
+                  "SELECT :user, MAX(:issuedBefore, IFNULL(MAX(issued_before), 0)), MAX(:expires, IFNULL(MAX(expires), 0)) "
+                  "FROM revoked_sessions WHERE user = :existingUser");
+    query.bindValue(":user", userId);
+    query.bindValue(":existingUser", userId);
+    query.bindValue(":issuedBefore", revocation.issuedBefore);
+    query.bindValue(":expires", revocation.expiresAt);
+    if (!query.exec()) {
+        qCWarning(lcUsers) << "Couldn't save token revocation, other instances won't see it" << query.lastError().text();
+    }
+}
+
+bool TokenRevocationList::isRevoked(const QString &userId, qint64 issuedAt) const
+{
+    const auto it = m_revoked.constFind(userId);
+
+    return it != m_revoked.cend() && issuedAt < it->issuedBefore;
+}
+
+void TokenRevocationList::reload()
+{
+    TraceSpan span("reloadRevokedSessions", "sql");
+
+    const qint64 now = QDateTime::currentSecsSinceEpoch();
+
+    // Expired tokens fail verification on their own, no need to remember them.
+    QSqlQuery query;
+    query.prepare("DELETE FROM revoked_sessions WHERE expires <= :now");
+    query.bindValue(":now", now);
+    query.exec();
+
+    if (!query.exec("SELECT user, issued_before, expires FROM revoked_sessions")) {
+        qCWarning(lcUsers) << "Couldn't load token revocations" << query.lastError().text();
+        return;
+    }
+
+    QHash<QString, Revocation> revoked;
+    while (query.next()) {
+        Revocation &revocation = revoked[query.value(0).toString()];
+        revocation.issuedBefore = query.value(1).toLongLong();
+        revocation.expiresAt = query.value(2).toLongLong();
+    }
+
+    // Keeps our own revocations even if saving them failed.
+    for (auto it = m_revoked.cbegin(); it != m_revoked.cend(); ++it) {
+        if (it->expiresAt > now) {
+            Revocation &revocation = revoked[it.key()];
+            revocation.issuedBefore = qMax(revocation.issuedBefore, it->issuedBefore);
+            revocation.expiresAt = qMax(revocation.expiresAt, it->expiresAt);
+        }
+    }
+
+    m_revoked = revoked;
+}
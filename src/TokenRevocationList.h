@@ -0,0 +1,38 @@
+#ifndef TOKENREVOCATIONLIST_H
+#define TOKENREVOCATIONLIST_H
+
+#include <QHash>
+#include <QObject>
+
+class QTimer;
+
+// Per user, the time before which all of its session tokens were revoked by logging out or in,
+// persisted in the "revoked_sessions" table of the user database. Lookups only touch the
+// in-memory copy; it is reloaded periodically so revocations made by other instances sharing
+// the database show up, and rows are dropped once every token they cover has expired anyway.
+class TokenRevocationList : public QObject {
+
+    Q_OBJECT
+
+public:
+    explicit TokenRevocationList(QObject *parent = nullptr);
+
+    // Revokes the user's tokens issued before issuedBefore (msecs since the epoch), all of which
+    // expire by expiresAt (secs since the epoch).
+    void revoke(const QString &userId, qint64 issuedBefore, qint64 expiresAt);
+    bool isRevoked(const QString &userId, qint64 issuedAt) const;
+
+private slots:
+    void reload();
+
+private:
+    struct Revocation {
+        qint64 issuedBefore = 0;
+        qint64 expiresAt = 0;
+    };
+
+    QHash<QString, Revocation> m_revoked;
+    QTimer *m_reloadTimer = nullptr;
+};
+
+#endif // TOKENREVOCATIONLIST_H
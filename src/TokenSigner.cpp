@@ -0,0 +1,186 @@
+#include "TokenSigner.h"
+#include "Logger.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QMessageAuthenticationCode>
+#include <QRandomGenerator>
+
+namespace {
+
+const int keySize = 32;
+const int nonceSize = 8;
+
+QByteArray randomBytes(int size)
+{
+    QByteArray bytes(size, Qt::Uninitialized);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32 *>(bytes.data()), size / 4);
+
+    return bytes;
+}
+
+// Doesn't stop at the first difference, so the time taken says nothing about the mac.
+bool constantTimeEquals(const QByteArray &a, const QByteArray &b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+
+    char difference = 0;
+    for (int i = 0; i < a.size(); ++i) {
+        difference |= a.at(i) ^ b.at(i);
+    }
+
+    return difference == 0;
+}
+
+}
+
+TokenSigner::TokenSigner(QObject *parent) : QObject(parent)
+{
+    // Tokens signed with this key die with the process, setKeyFile() replaces it.
+    m_keys.insert(m_signingKeyId, randomBytes(keySize));
+}
+
+bool TokenSigner::setKeyFile(const QString &path)
+{
+    m_keyFile = path;
+
+    if (!QFile::exists(path)) {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            qCCritical(lcUsers) << "Couldn't create token key file" << path << file.errorString();
+            return false;
+        }
+
+        file.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+        file.write("# <key id> <base64 secret>, the last key signs new tokens\n1 " + randomBytes(keySize).toBase64() + '\n');
+
+        qCInfo(lcUsers) << "Created token key file" << path;
+    }
+
+    if (!loadKeys()) {
+        return false;
+    }
+
+    if (!m_keyFileWatcher) {
+        m_keyFileWatcher = new QFileSystemWatcher(this);
+        connect(m_keyFileWatcher, &QFileSystemWatcher::fileChanged, this, &TokenSigner::onKeyFileChanged);
+    }
+    m_keyFileWatcher->addPath(path);
+
+    return true;
+}
+
+QString TokenSigner::sign(const QString &userId, qint64 issuedAt, qint64 expiresAt) const
+{
+    const QByteArray payload = userId.toLatin1() + '.' + QByteArray::number(issuedAt) + '.' + QByteArray::number(expiresAt) + '.'
+            + QByteArray::number(m_signingKeyId) + '.' + randomBytes(nonceSize).toHex();
+
+    return QString::fromLatin1(payload + '.' + mac(m_signingKeyId, payload));
+}
+
+bool TokenSigner::verify(const QString &token, Claims *claims) const
+{
+    const QByteArray bytes = token.toLatin1();
+
+    const int macSeparator = bytes.lastIndexOf('.');
+    if (macSeparator <= 0) {
+        return false;
+    }
+
+    const QByteArray payload = bytes.left(macSeparator);
+    const QList<QByteArray> parts = payload.split('.');
+    if (parts.size() != 5) {
+        return false;
+    }
+
+    bool validIssue = false;
+    bool validExpiry = false;
+    bool validKeyId = false;
+    const qint64 issuedAt = parts.at(1).toLongLong(&validIssue);
+    const qint64 expiresAt = parts.at(2).toLongLong(&validExpiry);
+    const quint32 keyId = parts.at(3).toUInt(&validKeyId);
+    if (!validIssue || !validExpiry || !validKeyId || !m_keys.contains(keyId)) {
+        return false;
+    }
+
+    if (!constantTimeEquals(mac(keyId, payload), bytes.mid(macSeparator + 1))) {
+        return false;
+    }
+
+    if (expiresAt <= QDateTime::currentSecsSinceEpoch()) {
+        return false;
+    }
+
+    if (claims) {
+        claims->userId = QString::fromLatin1(parts.at(0));
+        claims->issuedAt = issuedAt;
+        claims->expiresAt = expiresAt;
+        claims->keyId = keyId;
+        claims->nonce = parts.at(4);
+    }
+
+    return true;
+}
+
+void TokenSigner::onKeyFileChanged()
+{
+    loadKeys();
+
+    // Editors usually replace the file, which drops it from the watcher.
+    if (!m_keyFileWatcher->files().contains(m_keyFile)) {
+        m_keyFileWatcher->addPath(m_keyFile);
+    }
+}
+
+bool TokenSigner::loadKeys()
+{
+    QFile file(m_keyFile);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qCCritical(lcUsers) << "Couldn't read token key file" << m_keyFile << file.errorString();
+        return false;
+    }
+
+    QHash<quint32, QByteArray> keys;
+    quint32 signingKeyId = 0;
+
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+
+        const QList<QByteArray> fields = line.simplified().split(' ');
+        bool validId = false;
+        const quint32 keyId = fields.size() == 2 ? fields.at(0).toUInt(&validId) : 0;
+        const QByteArray secret = validId ? QByteArray::fromBase64(fields.at(1)) : QByteArray();
+        if (secret.size() < keySize / 2) {
+            qCWarning(lcUsers) << "Ignoring invalid line in token key file" << m_keyFile;
+            continue;
+        }
+
+        keys.insert(keyId, secret);
+        signingKeyId = keyId;
+    }
+
+    // A half-written file must not log everyone out, keep the keys we have.
+    if (keys.isEmpty()) {
+        qCWarning(lcUsers) << "No keys in token key file" << m_keyFile << "- keeping the current keys";
+        return false;
+    }
+
+    m_keys = keys;
+    m_signingKeyId = signingKeyId;
+
+    qCInfo(lcUsers) << "Loaded token keys" << LogField("keys", keys.size()) << LogField("signingKey", signingKeyId);
+
+    return true;
+}
+
+QByteArray TokenSigner::mac(quint32 keyId, const QByteArray &payload) const
+{
+    return QMessageAuthenticationCode::hash(payload, m_keys.value(keyId), QCryptographicHash::Sha256)
+            .toBase64(QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals);
+}
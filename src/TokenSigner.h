@@ -0,0 +1,55 @@
+#ifndef TOKENSIGNER_H
+#define TOKENSIGNER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+
+class QFileSystemWatcher;
+
+// Issues and checks stateless session tokens of the form
+// "<user id>.<issued at>.<expiry>.<key id>.<nonce>.<mac>", where the issue time is in msecs and
+// the expiry in seconds since the epoch, the nonce tells tokens issued in the same msec apart and
+// the mac is the base64url HMAC-SHA256 of everything before it. Any process holding the key can
+// check a token without looking it up.
+//
+// Keys are read from a file with one "<key id> <base64 secret>" line per key. The last key
+// signs new tokens, all of them are accepted, so rotating means appending a key and dropping
+// old ones once their tokens have expired. The file is reloaded whenever it changes.
+class TokenSigner : public QObject {
+
+    Q_OBJECT
+
+public:
+    struct Claims {
+        QString userId;
+        qint64 issuedAt = 0;
+        qint64 expiresAt = 0;
+        quint32 keyId = 0;
+        QByteArray nonce;
+    };
+
+    explicit TokenSigner(QObject *parent = nullptr);
+
+    // Creates the file with a fresh key if it doesn't exist yet.
+    bool setKeyFile(const QString &path);
+
+    QString sign(const QString &userId, qint64 issuedAt, qint64 expiresAt) const;
+    bool verify(const QString &token, Claims *claims) const;
+
+private slots:
+    void onKeyFileChanged();
+
+private:
+    bool loadKeys();
+    QByteArray mac(quint32 keyId, const QByteArray &payload) const;
+
+private:
+    QString m_keyFile;
+    QFileSystemWatcher *m_keyFileWatcher = nullptr;
+
+    QHash<quint32, QByteArray> m_keys;
+    quint32 m_signingKeyId = 0;
+};
+
+#endif // TOKENSIGNER_H
@@ -0,0 +1,287 @@
+#include "Tracer.h"
+#include "Logger.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <chrono>
+
+#ifdef Q_OS_UNIX
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const int defaultEventsPerThread = 65536;
+
+// Keeps a loop that stalls over and over from filling the disk with captures.
+const qint64 minimumCaptureIntervalNs = 10LL * 1000 * 1000 * 1000;
+
+thread_local void *currentRing = nullptr;
+
+#ifdef Q_OS_UNIX
+int signalDescriptors[2] = { -1, -1 };
+
+void handleDumpSignal(int)
+{
+    const char byte = 1;
+    const ssize_t written = ::write(signalDescriptors[0], &byte, sizeof(byte));
+    Q_UNUSED(written)
+}
+#endif
+
+}
+
+std::atomic<bool> Tracer::s_enabled(false);
+
+Tracer::Tracer(QObject *parent) : QObject(parent)
+{
+}
+
+Tracer *Tracer::instance()
+{
+    static Tracer *tracer = new Tracer(qApp);
+    return tracer;
+}
+
+qint64 Tracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracer::record(const char *name, const char *category, qint64 startNs, qint64 durationNs)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    Ring *ring = instance()->threadRing();
+
+    QMutexLocker locker(&ring->mutex);
+
+    Event &event = ring->events[ring->next];
+    event.name = name;
+    event.category = category;
+    event.startNs = startNs;
+    event.durationNs = durationNs;
+
+    if (++ring->next == ring->events.size()) {
+        ring->next = 0;
+        ring->wrapped = true;
+    }
+}
+
+void Tracer::enable(int eventsPerThread)
+{
+    m_eventsPerThread = eventsPerThread > 0 ? eventsPerThread : defaultEventsPerThread;
+    s_enabled.store(true, std::memory_order_relaxed);
+
+    qCDebug(lcTrace) << "Tracing enabled with" << m_eventsPerThread << "events per thread";
+}
+
+void Tracer::setDumpDirectory(const QString &directory)
+{
+    m_dumpDirectory = directory;
+}
+
+void Tracer::setStallDetection(int thresholdMs, int windowMs)
+{
+    m_stallThresholdMs = thresholdMs;
+    m_stallWindowMs = windowMs;
+
+    if (thresholdMs <= 0) {
+        if (m_heartbeat) {
+            m_heartbeat->stop();
+        }
+        return;
+    }
+
+    if (!m_heartbeat) {
+        m_heartbeat = new QTimer(this);
+        m_heartbeat->setTimerType(Qt::PreciseTimer);
+        connect(m_heartbeat, &QTimer::timeout, this, &Tracer::onHeartbeat);
+    }
+
+    // The loop is considered stalled when a tick arrives more than thresholdMs late.
+    m_heartbeat->setInterval(qMax(1, thresholdMs / 4));
+    m_lastHeartbeatNs = now();
+    m_heartbeat->start();
+}
+
+bool Tracer::installSignalHandler()
+{
+#ifdef Q_OS_UNIX
+    if (m_signalNotifier) {
+        return true;
+    }
+
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, signalDescriptors) != 0) {
+        qCWarning(lcTrace) << "Couldn't create the trace dump signal pipe";
+        return false;
+    }
+
+    struct sigaction action;
+    action.sa_handler = handleDumpSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+
+    if (::sigaction(SIGUSR2, &action, nullptr) != 0) {
+        qCWarning(lcTrace) << "Couldn't install the SIGUSR2 handler";
+        return false;
+    }
+
+    m_signalNotifier = new QSocketNotifier(signalDescriptors[1], QSocketNotifier::Read, this);
+    connect(m_signalNotifier, &QSocketNotifier::activated, this, &Tracer::onSignal);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+QByteArray Tracer::toJson(qint64 sinceNs) const
+{
+    const qint64 pid = QCoreApplication::applicationPid();
+
+    QJsonArray traceEvents;
+
+    QMutexLocker ringsLocker(&m_ringsMutex);
+    for (const auto &ring : m_rings) {
+        std::vector<Event> events;
+        {
+            QMutexLocker locker(&ring->mutex);
+            if (ring->wrapped) {
+                events.assign(ring->events.begin() + static_cast<std::ptrdiff_t>(ring->next), ring->events.end());
+            }
+            events.insert(events.end(), ring->events.begin(), ring->events.begin() + static_cast<std::ptrdiff_t>(ring->next));
+        }
+
+        QJsonObject threadName;
+        threadName["name"] = "thread_name";
+        threadName["ph"] = "M";
+        threadName["pid"] = pid;
+        threadName["tid"] = ring->threadIndex;
+        threadName["args"] = QJsonObject { { "name", ring->threadIndex == 0 ? QStringLiteral("main")
+                                                                           : QStringLiteral("thread %1").arg(ring->threadIndex) } };
+        traceEvents.append(threadName);
+
+        for (const Event &event : events) {
+            if (event.startNs + event.durationNs < sinceNs) {
+                continue;
+            }
+
+            QJsonObject traceEvent;
+            traceEvent["name"] = QLatin1String(event.name);
+            traceEvent["cat"] = QLatin1String(event.category);
+            traceEvent["ph"] = "X";
+            traceEvent["ts"] = event.startNs / 1000.0;
+            traceEvent["dur"] = event.durationNs / 1000.0;
+            traceEvent["pid"] = pid;
+            traceEvent["tid"] = ring->threadIndex;
+            traceEvents.append(traceEvent);
+        }
+    }
+
+    QJsonObject trace;
+    trace["traceEvents"] = traceEvents;
+    trace["displayTimeUnit"] = "ms";
+
+    return QJsonDocument(trace).toJson(QJsonDocument::Compact);
+}
+
+QString Tracer::dump(const QString &reason, qint64 sinceNs) const
+{
+    const QString fileName = QStringLiteral("trace-%1-%2.json")
+            .arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss-zzz"), reason);
+    const QString path = QDir(m_dumpDirectory.isEmpty() ? QDir::currentPath() : m_dumpDirectory).filePath(fileName);
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcTrace) << "Couldn't write trace" << path << file.errorString();
+        return QString();
+    }
+
+    file.write(toJson(sinceNs));
+
+    if (!file.commit()) {
+        qCWarning(lcTrace) << "Couldn't commit trace" << path << file.errorString();
+        return QString();
+    }
+
+    return path;
+}
+
+void Tracer::onHeartbeat()
+{
+    const qint64 tick = now();
+    const qint64 expectedNs = static_cast<qint64>(m_heartbeat->interval()) * 1000 * 1000;
+    const qint64 lateNs = tick - m_lastHeartbeatNs - expectedNs;
+
+    m_lastHeartbeatNs = tick;
+
+    if (lateNs <= static_cast<qint64>(m_stallThresholdMs) * 1000 * 1000) {
+        return;
+    }
+
+    record("eventLoopStall", "stall", tick - lateNs, lateNs);
+
+    qCWarning(lcTrace) << "Event loop was blocked for" << lateNs / 1000000 << "ms";
+
+    if (!isEnabled() || tick - m_lastCaptureNs < minimumCaptureIntervalNs) {
+        return;
+    }
+
+    m_lastCaptureNs = tick;
+
+    const QString path = dump("stall", tick - lateNs - static_cast<qint64>(m_stallWindowMs) * 1000 * 1000);
+    if (!path.isEmpty()) {
+        qCWarning(lcTrace) << "Captured the stall in" << path;
+    }
+}
+
+void Tracer::onSignal()
+{
+#ifdef Q_OS_UNIX
+    char byte;
+    const ssize_t received = ::read(signalDescriptors[1], &byte, sizeof(byte));
+    Q_UNUSED(received)
+#endif
+
+    if (!isEnabled()) {
+        qCWarning(lcTrace) << "Trace dump requested, but tracing is disabled";
+        return;
+    }
+
+    const QString path = dump("signal");
+    if (!path.isEmpty()) {
+        qCDebug(lcTrace) << "Trace written" << LogField("path", path);
+    }
+}
+
+Tracer::Ring *Tracer::threadRing()
+{
+    if (currentRing) {
+        return static_cast<Ring*>(currentRing);
+    }
+
+    auto ring = std::make_unique<Ring>();
+    ring->events.resize(static_cast<size_t>(m_eventsPerThread > 0 ? m_eventsPerThread : defaultEventsPerThread));
+
+    QMutexLocker locker(&m_ringsMutex);
+    ring->threadIndex = static_cast<int>(m_rings.size());
+    m_rings.push_back(std::move(ring));
+
+    currentRing = m_rings.back().get();
+
+    return m_rings.back().get();
+}
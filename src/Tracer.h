@@ -0,0 +1,114 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QObject>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class QSocketNotifier;
+class QTimer;
+
+// Optional low-overhead tracing. Spans are recorded as complete events into a fixed-size ring
+// buffer per thread and can be dumped as Chrome trace / Perfetto JSON, on SIGUSR2, through the
+// HTTP /trace endpoint or automatically when the event loop stalls. While tracing is disabled a
+// span costs a single relaxed atomic load.
+class Tracer : public QObject {
+
+    Q_OBJECT
+
+public:
+    struct Event {
+        // Names and categories must be string literals or otherwise outlive the tracer.
+        const char *name = nullptr;
+        const char *category = nullptr;
+        qint64 startNs = 0;
+        qint64 durationNs = 0;
+    };
+
+    static Tracer *instance();
+
+    static bool isEnabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    // Nanoseconds on a monotonic clock, the time base of all events.
+    static qint64 now();
+    static void record(const char *name, const char *category, qint64 startNs, qint64 durationNs);
+
+    void enable(int eventsPerThread);
+    void setDumpDirectory(const QString &directory);
+    void setStallDetection(int thresholdMs, int windowMs);
+    bool installSignalHandler();
+
+    // Events which ended at or after sinceNs, in Chrome trace JSON.
+    QByteArray toJson(qint64 sinceNs = 0) const;
+    QString dump(const QString &reason, qint64 sinceNs = 0) const;
+
+private slots:
+    void onHeartbeat();
+    void onSignal();
+
+private:
+    struct Ring {
+        QMutex mutex;
+        std::vector<Event> events;
+        size_t next = 0;
+        bool wrapped = false;
+        int threadIndex = 0;
+    };
+
+    explicit Tracer(QObject *parent = nullptr);
+
+    Ring *threadRing();
+
+private:
+    static std::atomic<bool> s_enabled;
+
+    mutable QMutex m_ringsMutex;
+    std::vector<std::unique_ptr<Ring>> m_rings;
+    int m_eventsPerThread = 0;
+
+    QString m_dumpDirectory;
+
+    QTimer *m_heartbeat = nullptr;
+    qint64 m_lastHeartbeatNs = 0;
+    qint64 m_lastCaptureNs = 0;
+    int m_stallThresholdMs = 0;
+    int m_stallWindowMs = 0;
+
+    QSocketNotifier *m_signalNotifier = nullptr;
+};
+
+// Records the lifetime of the enclosing scope as a span.
+class TraceSpan {
+
+public:
+    TraceSpan(const char *name, const char *category)
+        : m_name(name)
+        , m_category(category)
+        , m_startNs(Tracer::isEnabled() ? Tracer::now() : -1)
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if (m_startNs >= 0) {
+            Tracer::record(m_name, m_category, m_startNs, Tracer::now() - m_startNs);
+        }
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *m_name;
+    const char *m_category;
+    qint64 m_startNs;
+};
+
+#endif // TRACER_H
@@ -0,0 +1,285 @@
+#include "TrafficCapture.h"
+#include "Logger.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QRandomGenerator>
+#include <QSet>
+#include <QtEndian>
+
+#include <cstring>
+
+namespace {
+
+const char captureMagic[4] = { 'Q', 'M', 'S', 'C' };
+const quint32 captureVersion = 1;
+
+// Anything larger is a corrupted file rather than a frame.
+const quint64 maxPayloadSize = 64 * 1024 * 1024;
+
+void appendVarint(QByteArray &buffer, quint64 value)
+{
+    while (value >= 0x80) {
+        buffer.append(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    buffer.append(static_cast<char>(value));
+}
+
+bool readVarint(QIODevice *device, quint64 &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        char byte = 0;
+        if (!device->getChar(&byte)) {
+            return false;
+        }
+
+        value |= static_cast<quint64>(static_cast<uchar>(byte) & 0x7f) << shift;
+        if (!(static_cast<uchar>(byte) & 0x80)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+}
+
+TrafficCapture::TrafficCapture()
+{
+}
+
+TrafficCapture::~TrafficCapture()
+{
+    close();
+}
+
+bool TrafficCapture::open(const QString &path, Redaction redaction)
+{
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(lcCapture) << "Couldn't open capture file" << path << m_file.errorString();
+        return false;
+    }
+
+    m_redaction = redaction;
+    m_lastTimestampUs = 0;
+
+    // Pseudonyms are stable within one capture only, so they can't be matched across files.
+    m_pseudonymKey.resize(32);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32 *>(m_pseudonymKey.data()), m_pseudonymKey.size() / 4);
+
+    QByteArray header(captureMagic, sizeof(captureMagic));
+    const quint32 version = qToLittleEndian(captureVersion);
+    const qint64 startMs = qToLittleEndian<qint64>(QDateTime::currentMSecsSinceEpoch());
+    header.append(reinterpret_cast<const char *>(&version), sizeof(version));
+    header.append(reinterpret_cast<const char *>(&startMs), sizeof(startMs));
+    m_file.write(header);
+
+    m_clock.start();
+
+    qCDebug(lcCapture) << "Capturing inbound traffic" << LogField("path", path);
+
+    return true;
+}
+
+void TrafficCapture::close()
+{
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+bool TrafficCapture::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+void TrafficCapture::recordOpen(quint64 connectionId)
+{
+    writeRecord(OpenRecord, connectionId, 0, QByteArray(), 0);
+}
+
+void TrafficCapture::recordClose(quint64 connectionId)
+{
+    writeRecord(CloseRecord, connectionId, 0, QByteArray(), 0);
+}
+
+void TrafficCapture::recordFrame(quint64 connectionId, const QByteArray &payload)
+{
+    if (!isOpen()) {
+        return;
+    }
+
+    const quint32 payloadSize = static_cast<quint32>(payload.size());
+
+    switch (m_redaction) {
+    case NoRedaction:
+        writeRecord(FrameRecord, connectionId, 0, payload, payloadSize);
+        break;
+    case ValueRedaction:
+        writeRecord(FrameRecord, connectionId, RedactedPayload, redactValues(payload), payloadSize);
+        break;
+    case PayloadRedaction:
+        writeRecord(FrameRecord, connectionId, RedactedPayload, QByteArray(), payloadSize);
+        break;
+    }
+}
+
+void TrafficCapture::recordBinaryFrame(quint64 connectionId, int size)
+{
+    if (!isOpen()) {
+        return;
+    }
+
+    writeRecord(FrameRecord, connectionId, RedactedPayload | BinaryPayload, QByteArray(), static_cast<quint32>(size));
+}
+
+TrafficCapture::Redaction TrafficCapture::redactionFromString(const QString &name, bool *ok)
+{
+    if (ok) {
+        *ok = true;
+    }
+
+    if (name == QLatin1String("none")) {
+        return NoRedaction;
+    } else if (name == QLatin1String("values")) {
+        return ValueRedaction;
+    } else if (name == QLatin1String("payload")) {
+        return PayloadRedaction;
+    }
+
+    if (ok) {
+        *ok = false;
+    }
+
+    return PayloadRedaction;
+}
+
+bool TrafficCapture::readHeader(QIODevice *device, qint64 *startMs)
+{
+    char header[sizeof(captureMagic) + sizeof(quint32) + sizeof(qint64)];
+    if (device->read(header, sizeof(header)) != static_cast<qint64>(sizeof(header))
+            || std::memcmp(header, captureMagic, sizeof(captureMagic)) != 0
+            || qFromLittleEndian<quint32>(header + sizeof(captureMagic)) != captureVersion) {
+        return false;
+    }
+
+    if (startMs) {
+        *startMs = qFromLittleEndian<qint64>(header + sizeof(captureMagic) + sizeof(quint32));
+    }
+
+    return true;
+}
+
+bool TrafficCapture::readRecord(QIODevice *device, Record &record, qint64 &previousTimestampUs)
+{
+    char type = 0;
+    quint64 delta = 0;
+    quint64 connectionId = 0;
+
+    if (!device->getChar(&type) || type < OpenRecord || type > FrameRecord
+            || !readVarint(device, delta) || !readVarint(device, connectionId)) {
+        return false;
+    }
+
+    record.type = static_cast<RecordType>(type);
+    record.timestampUs = previousTimestampUs + static_cast<qint64>(delta);
+    record.connectionId = connectionId;
+    record.flags = 0;
+    record.payloadSize = 0;
+    record.payload.clear();
+
+    if (record.type == FrameRecord) {
+        char flags = 0;
+        quint64 payloadSize = 0;
+        quint64 storedSize = 0;
+
+        if (!device->getChar(&flags) || !readVarint(device, payloadSize) || !readVarint(device, storedSize)
+                || payloadSize > maxPayloadSize || storedSize > maxPayloadSize) {
+            return false;
+        }
+
+        record.flags = static_cast<quint8>(flags);
+        record.payloadSize = static_cast<quint32>(payloadSize);
+        record.payload = device->read(static_cast<qint64>(storedSize));
+        if (record.payload.size() != static_cast<int>(storedSize)) {
+            return false;
+        }
+    }
+
+    previousTimestampUs = record.timestampUs;
+
+    return true;
+}
+
+void TrafficCapture::writeRecord(RecordType type, quint64 connectionId, quint8 flags, const QByteArray &payload, quint32 payloadSize)
+{
+    if (!isOpen()) {
+        return;
+    }
+
+    const qint64 timestampUs = m_clock.nsecsElapsed() / 1000;
+
+    QByteArray record;
+    record.reserve(payload.size() + 24);
+    record.append(static_cast<char>(type));
+    appendVarint(record, static_cast<quint64>(timestampUs - m_lastTimestampUs));
+    appendVarint(record, connectionId);
+
+    if (type == FrameRecord) {
+        // The original size is kept apart from the stored one, redacted payloads may differ from it.
+        record.append(static_cast<char>(flags));
+        appendVarint(record, payloadSize);
+        appendVarint(record, static_cast<quint64>(payload.size()));
+        record.append(payload);
+    }
+
+    m_lastTimestampUs = timestampUs;
+
+    if (m_file.write(record) != record.size()) {
+        qCWarning(lcCapture) << "Couldn't write to capture file, stopping the capture:" << m_file.errorString();
+        close();
+    }
+}
+
+QByteArray TrafficCapture::redactValues(const QByteArray &payload) const
+{
+    QJsonObject object = QJsonDocument::fromJson(payload).object();
+    if (object.isEmpty()) {
+        // Not a request we understand, nothing of it may leak.
+        return QByteArray();
+    }
+
+    // Only these are kept as they are. Directory cursors contain the user name, so they get a
+    // pseudonym too. Any other string is blanked, any other value dropped, including fields
+    // added to requests later.
+    static const QSet<QString> keptFields = { "action", "limit", "lastSeq", "size", "credit", "target" };
+    static const QSet<QString> pseudonymFields = { "token", "name", "cursor" };
+
+    QJsonObject redacted;
+    for (auto it = object.constBegin(); it != object.constEnd(); ++it) {
+        const QJsonValue value = it.value();
+
+        if (keptFields.contains(it.key())) {
+            redacted.insert(it.key(), value);
+        } else if (!value.isString()) {
+            continue;
+        } else if (pseudonymFields.contains(it.key()) && !value.toString().isEmpty()) {
+            QCryptographicHash hash(QCryptographicHash::Sha256);
+            hash.addData(m_pseudonymKey);
+            hash.addData(value.toString().toUtf8());
+            redacted.insert(it.key(), QString::fromLatin1(hash.result().toHex().left(16)));
+        } else {
+            redacted.insert(it.key(), QString(value.toString().size(), QLatin1Char('x')));
+        }
+    }
+
+    return QJsonDocument(redacted).toJson(QJsonDocument::Compact);
+}
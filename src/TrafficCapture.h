@@ -0,0 +1,78 @@
+#ifndef TRAFFICCAPTURE_H
+#define TRAFFICCAPTURE_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+
+// Records inbound WebSocket traffic to a compact binary file which the replay tool plays back
+// against a local server. The file starts with "QMSC", a u32 version and the i64 wall clock
+// start in ms, followed by records: u8 type, varint microseconds since the previous record,
+// varint connection id and, for frames, u8 flags, varint original payload size, varint stored
+// payload size and the stored payload.
+class TrafficCapture
+{
+public:
+    enum RecordType {
+        OpenRecord,
+        CloseRecord,
+        FrameRecord
+    };
+
+    enum Redaction {
+        // Payloads are stored as received.
+        NoRedaction,
+        // Messages, passwords and keys are blanked out and tokens replaced by stable pseudonyms,
+        // so the request structure and sizes survive.
+        ValueRedaction,
+        // Only the payload size is kept.
+        PayloadRedaction
+    };
+
+    enum RecordFlag {
+        RedactedPayload = 0x1,
+        // A binary frame, always stored by size only.
+        BinaryPayload = 0x2
+    };
+
+    struct Record {
+        RecordType type = OpenRecord;
+        qint64 timestampUs = 0;
+        quint64 connectionId = 0;
+        quint8 flags = 0;
+        quint32 payloadSize = 0;
+        QByteArray payload;
+    };
+
+    TrafficCapture();
+    ~TrafficCapture();
+
+    bool open(const QString &path, Redaction redaction);
+    void close();
+    bool isOpen() const;
+
+    void recordOpen(quint64 connectionId);
+    void recordClose(quint64 connectionId);
+    void recordFrame(quint64 connectionId, const QByteArray &payload);
+    // File chunks are the users' end-to-end encrypted data, only their size is kept.
+    void recordBinaryFrame(quint64 connectionId, int size);
+
+    static Redaction redactionFromString(const QString &name, bool *ok = nullptr);
+
+    // Reading side, used by the replay tool.
+    static bool readHeader(QIODevice *device, qint64 *startMs);
+    static bool readRecord(QIODevice *device, Record &record, qint64 &previousTimestampUs);
+
+private:
+    void writeRecord(RecordType type, quint64 connectionId, quint8 flags, const QByteArray &payload, quint32 payloadSize);
+    QByteArray redactValues(const QByteArray &payload) const;
+
+private:
+    QFile m_file;
+    Redaction m_redaction = NoRedaction;
+    QElapsedTimer m_clock;
+    qint64 m_lastTimestampUs = 0;
+    QByteArray m_pseudonymKey;
+};
+
+#endif // TRAFFICCAPTURE_H
@@ -1,4 +1,5 @@
 #include "User.h"
+#include <QCryptographicHash>
 #include <QWebSocket>
 
 User::User(const QString &id, const QString &name, const QString &password, QObject *parent)
@@ -27,7 +28,23 @@ QString User::publicKey() const
 
 void User::setPublicKey(const QString &publicKey)
 {
+    if (m_publicKey == publicKey) {
+        return;
+    }
+
     m_publicKey = publicKey;
+
+    // Presence only carries this short digest, clients fetch the key itself when it changes.
+    if (publicKey.isEmpty()) {
+        m_keyFingerprint.clear();
+    } else {
+        m_keyFingerprint = QString::fromLatin1(QCryptographicHash::hash(publicKey.toUtf8(), QCryptographicHash::Sha256).left(8).toHex());
+    }
+}
+
+QString User::keyFingerprint() const
+{
+    return m_keyFingerprint;
 }
 
 QString User::token() const
@@ -37,6 +54,11 @@ QString User::token() const
 
 void User::setToken(const QString &token)
 {
+    // A new session doesn't inherit the events of the previous one.
+    if (token != m_token) {
+        m_replayRing.clear();
+    }
+
     m_token = token;
 }
 
@@ -85,6 +107,11 @@ void User::setPassword(const QString &password)
     m_password = password;
 }
 
+ReplayRing &User::replayRing()
+{
+    return m_replayRing;
+}
+
 void User::setName(const QString &name)
 {
     m_name = name;
@@ -1,6 +1,8 @@
 #ifndef USER_H
 #define USER_H
 
+#include "ReplayRing.h"
+
 #include <QDateTime>
 #include <QObject>
 
@@ -18,7 +20,8 @@ public:
     void setName(const QString &name);
 
     QString publicKey() const;
-    void setPublicKey(const QString &password);
+    void setPublicKey(const QString &publicKey);
+    QString keyFingerprint() const;
 
     QString token() const;
     void setToken(const QString &token);
@@ -32,6 +35,9 @@ public:
     QString password() const;
     void setPassword(const QString &password);
 
+    // Events sent to this user during the current session.
+    ReplayRing &replayRing();
+
 signals:
     void userDisconnected();
 
@@ -43,11 +49,14 @@ private:
     QString m_name = "";
     QString m_password = "";
     QString m_publicKey = "";
+    QString m_keyFingerprint = "";
 
     QString m_token = "";
     QDateTime m_lastActive;
 
     QWebSocket* m_socket = nullptr;
+
+    ReplayRing m_replayRing;
 };
 
 #endif // USER_H
@@ -1,13 +1,25 @@
+#include "Logger.h"
+#include "SessionStore.h"
+#include "TokenRevocationList.h"
+#include "TokenSigner.h"
+#include "Tracer.h"
 #include "User.h"
 #include "UserManager.h"
-#include "quuid.h"
 
 #include <QCryptographicHash>
 #include <QSqlQuery>
+#include <QTimer>
 #include <QVariant>
 #include <QRandomGenerator>
 #include <QSqlError>
 
+namespace {
+
+const int idleTimeoutSeconds = 600;
+const int idleSweepIntervalMs = 60000;
+
+}
+
 UserManager::UserManager(QObject *parent) : QObject(parent) {
     m_database = QSqlDatabase::addDatabase("QSQLITE");
     m_database.setDatabaseName("users.db");
@@ -18,11 +30,32 @@ UserManager::UserManager(QObject *parent) : QObject(parent) {
 
     QSqlQuery query;
     query.exec("CREATE TABLE IF NOT EXISTS users (id TEXT PRIMARY KEY, name TEXT, password TEXT)");
+
+    m_tokenSigner = new TokenSigner(this);
+    m_revokedTokens = new TokenRevocationList(this);
+
+    // Swept periodically rather than on every lookup, which would cost a scan of all users each time.
+    QTimer *idleTimer = new QTimer(this);
+    connect(idleTimer, &QTimer::timeout, this, &UserManager::deauthorizeInactiveUsers);
+    idleTimer->start(idleSweepIntervalMs);
+}
+
+bool UserManager::setTokenKeyFile(const QString &path)
+{
+    return m_tokenSigner->setKeyFile(path);
+}
+
+void UserManager::setTokenLifetime(int seconds)
+{
+    m_tokenLifetime = seconds;
 }
 
 void UserManager::loadUsers() {
     qDeleteAll(m_users);
     m_users.clear();
+    m_activeUsersByName.clear();
+    m_usersById.clear();
+    m_usersByName.clear();
 
     QSqlQuery query("SELECT * FROM users");
     while (query.next()) {
@@ -33,6 +66,8 @@ void UserManager::loadUsers() {
 }
 
 bool UserManager::saveUser(const QString &name, const QString &password) {
+    TraceSpan span("saveUser", "sql");
+
     User *alreadyExisting = findUserByName(name);
 
     if (alreadyExisting) {
@@ -58,8 +93,9 @@ bool UserManager::saveUser(const QString &name, const QString &password) {
 }
 
 User *UserManager::authenticateUser(const QString &name, const QString &password) {
-    for (User* user : qAsConst(m_users)) {
-        if (user->name().toLower() == name.toLower() && user->password() == password) {
+    const auto candidates = m_usersByName.values(name.toLower());
+    for (User* user : candidates) {
+        if (user->password() == password) {
             return user;
         }
     }
@@ -68,56 +104,59 @@ User *UserManager::authenticateUser(const QString &name, const QString &password
 
 User *UserManager::findUserByToken(const QString &token)
 {
-    deauthorizeInactiveUsers();
-    const auto result = std::find_if(m_users.begin(), m_users.end(), [&token](User* user){
-        if (user->token() == token) {
-            return true;
-        }
-
-        return false;
-    });
-
-    if (result == m_users.end()) {
+    // The token carries the user id and is checked by its mac alone, so any instance holding
+    // the key accepts it without having issued it. It doesn't touch the session of the user here.
+    TokenSigner::Claims claims;
+    if (!m_tokenSigner->verify(token, &claims) || m_revokedTokens->isRevoked(claims.userId, claims.issuedAt)) {
         return nullptr;
     }
 
-    return *result;
+    return findUserById(claims.userId);
 }
 
 User *UserManager::findUserByName(const QString &name)
 {
-    const auto result = std::find_if(m_users.begin(), m_users.end(), [&name](User* user){
-        if (user->name().toLower() == name.toLower()) {
-            return true;
+    return m_usersByName.value(name.toLower(), nullptr);
+}
+
+QList<User *> UserManager::findActiveUsersByPrefix(const QString &prefix, const QString &cursor, int limit, QString *nextCursor)
+{
+    const QString lowerPrefix = prefix.toLower();
+
+    // The cursor is the index key of the last user already returned, continue right after it.
+    // Only connected users are in the index, so a page never walks over offline ones.
+    auto it = cursor.isEmpty() ? m_activeUsersByName.lowerBound(lowerPrefix)
+                               : m_activeUsersByName.upperBound(cursor);
+
+    QList<User*> result;
+    for (; it != m_activeUsersByName.end() && it.key().startsWith(lowerPrefix); ++it) {
+        if (result.size() == limit) {
+            if (nextCursor) {
+                *nextCursor = activeIndexKey(result.last());
+            }
+            return result;
         }
 
-        return false;
-    });
+        result.append(it.value());
+    }
 
-    if (result == m_users.end()) {
-        return nullptr;
+    if (nextCursor) {
+        nextCursor->clear();
     }
 
-    return *result;
+    return result;
 }
 
-User *UserManager::findActiveUserById(const QString &id)
+User *UserManager::findUserById(const QString &id)
 {
-    const auto &activeUserList = activeUsers();
-
-    const auto result = std::find_if(activeUserList.begin(), activeUserList.end(), [&id](User* user){
-        if (user->id() == id) {
-            return true;
-        }
-
-        return false;
-    });
+    return m_usersById.value(id, nullptr);
+}
 
-    if (result == activeUserList.end()) {
-        return nullptr;
-    }
+User *UserManager::findActiveUserById(const QString &id)
+{
+    User *user = findUserById(id);
 
-    return *result;
+    return user && user->socket() ? user : nullptr;
 }
 
 void UserManager::deauthorizeUser(User *user)
@@ -126,26 +165,60 @@ void UserManager::deauthorizeUser(User *user)
         user->setToken("");
         user->setSocket(nullptr);
         emit activeUsersChanged();
+        emit presenceChanged(user);
+        emit sessionChanged(user);
+        emit userDeauthorized(user);
     }
 }
 
-void UserManager::authorizeUser(User *user, QWebSocket *socket)
+void UserManager::authorizeUser(User *user, QWebSocket *socket, const QString &token)
 {
     if (user) {
         if (socket) {
             user->setSocket(socket);
+            m_activeUsersByName.insert(activeIndexKey(user), user);
             emit activeUsersChanged();
+            emit presenceChanged(user);
         }
 
-        if (user->token().isEmpty()) {
-            const auto token = QUuid::createUuid().toString();
-            user->setToken(token);
+        user->setLastActive(QDateTime::currentDateTime());
+        emit activityChanged(user);
+
+        if (token.isEmpty() || token == user->token()) {
+            return;
         }
 
-        user->setLastActive(QDateTime::currentDateTime());
+        // Issued elsewhere or before an idle deauthorization. Logging in revokes every older
+        // token, so an older one than ours is only accepted until that reaches this instance.
+        TokenSigner::Claims claims;
+        TokenSigner::Claims current;
+        if (m_tokenSigner->verify(token, &claims)
+                && (!m_tokenSigner->verify(user->token(), &current) || claims.issuedAt > current.issuedAt)) {
+            user->setToken(token);
+            emit sessionChanged(user);
+        }
     }
 }
 
+QString UserManager::issueToken(User *user)
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const qint64 expiresAt = now / 1000 + m_tokenLifetime;
+
+    m_revokedTokens->revoke(user->id(), now, expiresAt);
+
+    user->setToken(m_tokenSigner->sign(user->id(), now, expiresAt));
+    emit sessionChanged(user);
+
+    return user->token();
+}
+
+void UserManager::revokeTokens(User *user)
+{
+    // Only tokens issued within this very msec survive, a login racing the logout wins.
+    m_revokedTokens->revoke(user->id(), QDateTime::currentMSecsSinceEpoch(), QDateTime::currentSecsSinceEpoch() + m_tokenLifetime);
+}
+
 QString UserManager::generateUniqueID() {
     const QString chars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
     const int idLength = 6;
@@ -186,7 +259,7 @@ void UserManager::deauthorizeInactiveUsers()
 {
     QDateTime now = QDateTime::currentDateTime();
     std::for_each(m_users.begin(), m_users.end(), [&now, this](User* user){
-        if (!user->token().isEmpty() && now.toSecsSinceEpoch() - user->lastActive().toSecsSinceEpoch() > 600) {
+        if (!user->token().isEmpty() && now.toSecsSinceEpoch() - user->lastActive().toSecsSinceEpoch() > idleTimeoutSeconds) {
             deauthorizeUser(user);
         }
     });
@@ -199,8 +272,20 @@ void UserManager::addUser(const QString &id, const QString &name, const QString
                           publicKey,
                           this);
     m_users.append(user);
+    m_usersById.insert(id, user);
+    m_usersByName.insert(name.toLower(), user);
 
-    connect(user, &User::userDisconnected, this, &UserManager::activeUsersChanged);
+    connect(user, &User::userDisconnected, this, [this, user]() {
+        m_activeUsersByName.remove(activeIndexKey(user));
+        emit activeUsersChanged();
+        emit presenceChanged(user);
+    });
+}
+
+QString UserManager::activeIndexKey(User *user)
+{
+    // The id keeps users whose names only differ in case apart.
+    return user->name().toLower() + QLatin1Char('\0') + user->id();
 }
 
 const QList<User *> &UserManager::users() const
@@ -208,14 +293,21 @@ const QList<User *> &UserManager::users() const
     return m_users;
 }
 
-QList<User *> UserManager::activeUsers()
+QList<User *> UserManager::activeUsers() const
 {
-    deauthorizeInactiveUsers();
+    return m_activeUsersByName.values();
+}
 
-    QList<User*> result;
-    std::copy_if(m_users.begin(), m_users.end(), std::back_inserter(result), [](User* user){
-        return user->socket();
-    });
+QByteArray UserManager::exportSessions() const
+{
+    return SessionStore::encode(m_users);
+}
 
-    return result;
+void UserManager::importSessions(const QByteArray &sessions)
+{
+    bool complete = false;
+    SessionStore::decode(sessions.constData(), sessions.size(), this, &complete);
+    if (!complete) {
+        qCWarning(lcUsers) << "Session table is corrupted, ignoring the rest of it";
+    }
 }
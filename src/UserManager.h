@@ -4,8 +4,13 @@
 #include <QSqlDatabase>
 #include <QObject>
 #include <QDateTime>
+#include <QHash>
+#include <QMap>
+#include <QMultiMap>
 
 class QWebSocket;
+class TokenRevocationList;
+class TokenSigner;
 class User;
 
 class UserManager : public QObject {
@@ -15,6 +20,9 @@ class UserManager : public QObject {
 public:
     explicit UserManager(QObject *parent = nullptr);
 
+    bool setTokenKeyFile(const QString &path);
+    void setTokenLifetime(int seconds);
+
     void loadUsers();
     bool saveUser(const QString& name, const QString& password);
 
@@ -22,16 +30,34 @@ public:
     User *findUserByToken(const QString& token);
     User *findUserByName(const QString& name);
 
+    User *findUserById(const QString& id);
     User *findActiveUserById(const QString& id);
+    QList<User *> findActiveUsersByPrefix(const QString& prefix, const QString& cursor, int limit, QString *nextCursor = nullptr);
 
     void deauthorizeUser(User *user);
-    void authorizeUser(User *user, QWebSocket* socket = nullptr);
+    // With a token, the client resumes that session here unless we know of a newer one.
+    void authorizeUser(User *user, QWebSocket* socket = nullptr, const QString &token = QString());
+    // Revokes every earlier token of the user and makes a new one its session token.
+    QString issueToken(User *user);
+    // Rejects every token issued to the user so far on every instance sharing the database.
+    void revokeTokens(User *user);
 
     const QList<User *>& users() const;
-    QList<User *> activeUsers();
+    // Connected users, ordered by name.
+    QList<User *> activeUsers() const;
+
+    QByteArray exportSessions() const;
+    void importSessions(const QByteArray &sessions);
 
 signals:
     void activeUsersChanged();
+    // The user connected, disconnected or logged out.
+    void presenceChanged(User *user);
+    void sessionChanged(User *user);
+    // Only the last activity of the user changed.
+    void activityChanged(User *user);
+    // The session ended, by logging out or by going idle.
+    void userDeauthorized(User *user);
 
 private:
     QString generateUniqueID();
@@ -40,11 +66,21 @@ private:
     QString generatePublicKey(const QString& username, const QString& hashedPassword);
 
     void deauthorizeInactiveUsers();
+    static QString activeIndexKey(User *user);
     void addUser(const QString &id, const QString& name, const QString& publicKey);
 
 private:
     QSqlDatabase m_database;
     QList<User*> m_users;
+    QHash<QString, User*> m_usersById;
+    // Keyed by lower-case name, ordered so that prefix queries are a range scan.
+    QMultiMap<QString, User*> m_usersByName;
+    // Connected users only, ordered by lower-case name, for the directory.
+    QMap<QString, User*> m_activeUsersByName;
+
+    TokenSigner *m_tokenSigner = nullptr;
+    TokenRevocationList *m_revokedTokens = nullptr;
+    int m_tokenLifetime = 12 * 60 * 60;
 };
 
 #endif // USERMANAGER_h
@@ -1,6 +1,10 @@
 #include <QCommandLineParser>
 #include <QCoreApplication>
 #include "ChatServer.h"
+#include "HttpServer.h"
+#include "Logger.h"
+#include "ReplayRing.h"
+#include "Tracer.h"
 
 int main(int argc, char *argv[]) {
     QCoreApplication app(argc, argv);
@@ -43,8 +47,156 @@ int main(int argc, char *argv[]) {
 
     parser.addOption(sslPrivateKeyOption);
 
+    QCommandLineOption upgradeSocketOption(QStringList() << "upgradeSocket" << "us",
+                                           "Take over listening sockets and sessions from a server running with the same path, and offer them to the next one.",
+                                           "path", "");
+    parser.addOption(upgradeSocketOption);
+
+    QCommandLineOption sessionSnapshotOption(QStringList() << "sessionSnapshot" << "ss",
+                                             "Keep sessions across restarts in the given snapshot file.", "path", "");
+    parser.addOption(sessionSnapshotOption);
+
+    QCommandLineOption sessionSnapshotIntervalOption(QStringList() << "sessionSnapshotInterval" << "ssi",
+                                                     "Set the session snapshot interval.", "seconds", "60");
+    parser.addOption(sessionSnapshotIntervalOption);
+
+    QCommandLineOption sessionJournalOption(QStringList() << "sessionJournal",
+                                            "Journal session changes between snapshots.");
+    parser.addOption(sessionJournalOption);
+
+    const HttpServer::ConnectionLimits defaultLimits;
+
+    QCommandLineOption httpMaxConnectionsOption(QStringList() << "httpMaxConnections",
+                                                "Set the maximum number of open HTTP(S) connections per listener.", "count",
+                                                QString::number(defaultLimits.maxConnections));
+    parser.addOption(httpMaxConnectionsOption);
+
+    QCommandLineOption httpMaxConnectionsPerIpOption(QStringList() << "httpMaxConnectionsPerIp",
+                                                     "Set the maximum number of open HTTP(S) connections per client address.", "count",
+                                                     QString::number(defaultLimits.maxConnectionsPerIp));
+    parser.addOption(httpMaxConnectionsPerIpOption);
+
+    QCommandLineOption httpIdleTimeoutOption(QStringList() << "httpIdleTimeout",
+                                             "Close idle HTTP(S) connections after the given time.", "ms",
+                                             QString::number(defaultLimits.idleTimeoutMs));
+    parser.addOption(httpIdleTimeoutOption);
+
+    QCommandLineOption httpHandshakeTimeoutOption(QStringList() << "httpHandshakeTimeout",
+                                                  "Close HTTPS connections which didn't finish the TLS handshake in the given time.", "ms",
+                                                  QString::number(defaultLimits.handshakeTimeoutMs));
+    parser.addOption(httpHandshakeTimeoutOption);
+
+    QCommandLineOption listenBacklogOption(QStringList() << "listenBacklog",
+                                           "Set the listen backlog of the HTTP(S) listeners.", "count",
+                                           QString::number(defaultLimits.listenBacklog));
+    parser.addOption(listenBacklogOption);
+
+    QCommandLineOption socketBufferSizeOption(QStringList() << "socketBufferSize",
+                                              "Set the send and receive buffer size of HTTP(S) connections, 0 keeps the system default.", "bytes", "0");
+    parser.addOption(socketBufferSizeOption);
+
+    QCommandLineOption disableNoDelayOption(QStringList() << "disableNoDelay",
+                                            "Don't set TCP_NODELAY on HTTP(S) connections.");
+    parser.addOption(disableNoDelayOption);
+
+    QCommandLineOption disableHttp2Option(QStringList() << "disableHttp2",
+                                          "Don't offer HTTP/2 on the HTTPS listener.");
+    parser.addOption(disableHttp2Option);
+
+    QCommandLineOption tokenKeysOption(QStringList() << "tokenKeys",
+                                       "Sign session tokens with the keys in the given file, created if missing. Instances sharing it accept each other's tokens.",
+                                       "path", "token.keys");
+    parser.addOption(tokenKeysOption);
+
+    QCommandLineOption tokenLifetimeOption(QStringList() << "tokenLifetime",
+                                           "Set how long a session token stays valid.", "seconds", "43200");
+    parser.addOption(tokenLifetimeOption);
+
+    QCommandLineOption replayBufferSizeOption(QStringList() << "replayBufferSize",
+                                              "Set the number of events kept per user and per room for clients resuming their session, 0 disables replay.", "count",
+                                              QString::number(ReplayRing::capacity()));
+    parser.addOption(replayBufferSizeOption);
+
+    QCommandLineOption presenceModeOption(QStringList() << "presenceMode",
+                                          "Send the active user list to every active user (broadcast), send changes to every active user and page the list through the directory (directory), or only send changes to subscribed contacts (contacts).", "mode", "broadcast");
+    parser.addOption(presenceModeOption);
+
+    QCommandLineOption captureOption(QStringList() << "capture",
+                                     "Record inbound WebSocket traffic to the given file for QMessageReplay.", "path", "");
+    parser.addOption(captureOption);
+
+    QCommandLineOption captureRedactionOption(QStringList() << "captureRedaction",
+                                              "Set what the capture keeps of each frame: none, values or payload.", "mode", "values");
+    parser.addOption(captureRedactionOption);
+
+    QCommandLineOption traceOption(QStringList() << "trace",
+                                   "Record request, presence, database and TLS spans. Dump them with SIGUSR2 or GET /trace from localhost.");
+    parser.addOption(traceOption);
+
+    QCommandLineOption traceBufferSizeOption(QStringList() << "traceBufferSize",
+                                             "Set the number of trace events kept per thread.", "count", "65536");
+    parser.addOption(traceBufferSizeOption);
+
+    QCommandLineOption traceDirectoryOption(QStringList() << "traceDirectory",
+                                            "Write trace dumps to the given directory.", "path", "");
+    parser.addOption(traceDirectoryOption);
+
+    QCommandLineOption stallThresholdOption(QStringList() << "stallThreshold",
+                                            "Report event loop stalls longer than the given time, 0 disables the detector.", "ms", "0");
+    parser.addOption(stallThresholdOption);
+
+    QCommandLineOption stallWindowOption(QStringList() << "stallWindow",
+                                         "Set how much of the trace before a stall is captured.", "ms", "1000");
+    parser.addOption(stallWindowOption);
+
+    QCommandLineOption logRulesOption(QStringList() << "logRules",
+                                      "Set logging rules, e.g. \"qmessage.*.debug=false;qmessage.tls.debug=true\".", "rules", "");
+    parser.addOption(logRulesOption);
+
+    QCommandLineOption logRulesFileOption(QStringList() << "logRulesFile",
+                                          "Apply logging rules from the given file, and again whenever it changes.", "path", "");
+    parser.addOption(logRulesFileOption);
+
+    QCommandLineOption logFormatOption(QStringList() << "logFormat",
+                                       "Set the log format, text or json.", "format", "text");
+    parser.addOption(logFormatOption);
+
+    QCommandLineOption logRepeatLimitOption(QStringList() << "logRepeatLimit",
+                                            "Suppress repeats of a message logged more often than this per second, 0 disables the limit.", "count", "20");
+    parser.addOption(logRepeatLimitOption);
+
+    QCommandLineOption logRepeatsByCallSiteOption(QStringList() << "logRepeatsByCallSite",
+                                                  "Count messages from the same line of code as repeats even when their text differs.");
+    parser.addOption(logRepeatsByCallSiteOption);
+
+    QCommandLineOption logBufferSizeOption(QStringList() << "logBufferSize",
+                                           "Set the number of log records queued per thread.", "count", "4096");
+    parser.addOption(logBufferSizeOption);
+
+    QCommandLineOption syncLoggingOption(QStringList() << "syncLogging",
+                                         "Keep Qt's synchronous stderr output instead of the asynchronous structured logger.");
+    parser.addOption(syncLoggingOption);
+
     parser.process(app);
 
+    Logger *logger = Logger::instance();
+    logger->setFormat(parser.value(logFormatOption) == QLatin1String("json") ? Logger::JsonFormat : Logger::TextFormat);
+    logger->setRepeatLimit(parser.value(logRepeatLimitOption).toInt());
+    logger->setRepeatsByCallSite(parser.isSet(logRepeatsByCallSiteOption));
+    logger->setBufferSize(parser.value(logBufferSizeOption).toInt());
+
+    if (parser.isSet(logRulesOption)) {
+        logger->setFilterRules(parser.value(logRulesOption).replace(';', '\n'));
+    }
+
+    if (!parser.isSet(syncLoggingOption)) {
+        logger->start();
+    }
+
+    if (parser.isSet(logRulesFileOption)) {
+        logger->watchFilterRulesFile(parser.value(logRulesFileOption));
+    }
+
     QString chatServerPort = parser.value(chatServerPortOption);
     QString httpServerPort = parser.value(httpServerPortOption);
     QString httpsServerPort = parser.value(httpsServerPortOption);
@@ -56,15 +208,71 @@ int main(int argc, char *argv[]) {
     bool disableHttps = parser.isSet(disableHttpsOption);
     bool disableWss = parser.isSet(disableWssOption);
 
+    QString upgradeSocket = parser.value(upgradeSocketOption);
+
+    QString sessionSnapshot = parser.value(sessionSnapshotOption);
+    QString sessionSnapshotInterval = parser.value(sessionSnapshotIntervalOption);
+    bool sessionJournal = parser.isSet(sessionJournalOption);
+
+    HttpServer::ConnectionLimits httpLimits;
+    httpLimits.maxConnections = parser.value(httpMaxConnectionsOption).toInt();
+    httpLimits.maxConnectionsPerIp = parser.value(httpMaxConnectionsPerIpOption).toInt();
+    httpLimits.idleTimeoutMs = parser.value(httpIdleTimeoutOption).toInt();
+    httpLimits.handshakeTimeoutMs = parser.value(httpHandshakeTimeoutOption).toInt();
+    httpLimits.listenBacklog = parser.value(listenBacklogOption).toInt();
+    httpLimits.sendBufferSize = parser.value(socketBufferSizeOption).toInt();
+    httpLimits.receiveBufferSize = httpLimits.sendBufferSize;
+    httpLimits.noDelay = !parser.isSet(disableNoDelayOption);
+
+    if (parser.isSet(traceOption)) {
+        Tracer *tracer = Tracer::instance();
+        tracer->enable(parser.value(traceBufferSizeOption).toInt());
+        tracer->setDumpDirectory(parser.value(traceDirectoryOption));
+        tracer->installSignalHandler();
+    }
+
+    if (parser.value(stallThresholdOption).toInt() > 0) {
+        Tracer::instance()->setStallDetection(parser.value(stallThresholdOption).toInt(),
+                                              parser.value(stallWindowOption).toInt());
+    }
+
     ChatServer server;
     if (!sslCertificate.isEmpty() && !sslPrivateKey.isEmpty()) {
         server.setupSSL(sslCertificate, sslPrivateKey);
     }
 
-    qDebug() << "test" << disableHttps << disableWss;
+    server.setUpgradeSocket(upgradeSocket);
+    server.setSessionSnapshot(sessionSnapshot, sessionSnapshotInterval.toInt(), sessionJournal);
+    if (!server.setSessionTokens(parser.value(tokenKeysOption), parser.value(tokenLifetimeOption).toInt())) {
+        qCCritical(lcUsers) << "Session tokens are signed with a temporary key and won't survive a restart";
+    }
+    server.setHttpConnectionLimits(httpLimits);
+    server.setHttp2Enabled(!parser.isSet(disableHttp2Option));
+    server.setReplayBufferSize(parser.value(replayBufferSizeOption).toInt());
+
+    bool validPresenceMode = false;
+    const ChatServer::PresenceMode presenceMode = ChatServer::presenceModeFromString(parser.value(presenceModeOption), &validPresenceMode);
+    if (!validPresenceMode) {
+        qCWarning(lcServer) << "Unknown presence mode" << parser.value(presenceModeOption) << "- using broadcast";
+    }
+    server.setPresenceMode(presenceMode);
+
+    if (parser.isSet(captureOption)) {
+        bool validRedaction = false;
+        const TrafficCapture::Redaction redaction = TrafficCapture::redactionFromString(parser.value(captureRedactionOption), &validRedaction);
+        if (!validRedaction) {
+            qCWarning(lcCapture) << "Unknown capture redaction" << parser.value(captureRedactionOption) << "- keeping payload sizes only";
+        }
+
+        server.setCapture(parser.value(captureOption), redaction);
+    }
 
     server.start(serverIp, httpServerPort.toInt(), httpsServerPort.toInt(), chatServerPort.toInt(),
                  disableHttps, disableWss);
 
-    return app.exec();
+    const int result = app.exec();
+
+    logger->stop();
+
+    return result;
 }
@@ -0,0 +1,82 @@
+#include "ChatRequest.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtTest>
+
+// Cost of turning a text frame into a request. QWebSocket hands text frames over as a QString
+// only, so the server converts it back to UTF-8 before the streaming decoder runs; the
+// conversion is measured on its own and together with the decode, next to the decode alone and
+// the generic QJsonDocument path it replaced.
+class BenchChatRequest : public QObject {
+
+    Q_OBJECT
+
+private slots:
+    void initTestCase_data();
+    void utf8Conversion();
+    void streamingDecode();
+    void conversionAndDecode();
+    void genericDecode();
+};
+
+void BenchChatRequest::initTestCase_data()
+{
+    QTest::addColumn<QString>("frame");
+
+    QTest::newRow("message") << QStringLiteral(R"({"action":3,"token":"abc123.1700000000000.1900000000.1.0123456789abcdef.mmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmm","target":"x1Y2z3","message":"hello"})");
+    QTest::newRow("4 KiB ciphertext") << QStringLiteral(R"({"action":3,"token":"abc123.1700000000000.1900000000.1.0123456789abcdef.mmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmm","target":"x1Y2z3","message":"%1"})")
+            .arg(QString(4096, QLatin1Char('Q')));
+    QTest::newRow("4 KiB non-ASCII") << QStringLiteral(R"({"action":3,"token":"abc123.1700000000000.1900000000.1.0123456789abcdef.mmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmm","target":"x1Y2z3","message":"%1"})")
+            .arg(QString(2048, QChar(0x00e9)));
+}
+
+void BenchChatRequest::utf8Conversion()
+{
+    QFETCH_GLOBAL(QString, frame);
+
+    QByteArray payload;
+    QBENCHMARK {
+        payload = frame.toUtf8();
+    }
+    QVERIFY(!payload.isEmpty());
+}
+
+void BenchChatRequest::streamingDecode()
+{
+    QFETCH_GLOBAL(QString, frame);
+    const QByteArray payload = frame.toUtf8();
+
+    ChatRequest request;
+    QBENCHMARK {
+        request = ChatRequest::fromJson(payload);
+    }
+    QCOMPARE(request.action(), 3);
+}
+
+void BenchChatRequest::conversionAndDecode()
+{
+    QFETCH_GLOBAL(QString, frame);
+
+    ChatRequest request;
+    QBENCHMARK {
+        request = ChatRequest::fromJson(frame.toUtf8());
+    }
+    QCOMPARE(request.action(), 3);
+}
+
+void BenchChatRequest::genericDecode()
+{
+    QFETCH_GLOBAL(QString, frame);
+    const QByteArray payload = frame.toUtf8();
+
+    ChatRequest request;
+    QBENCHMARK {
+        request = ChatRequest::fromJsonObject(QJsonDocument::fromJson(payload).object());
+    }
+    QCOMPARE(request.action(), 3);
+}
+
+QTEST_APPLESS_MAIN(BenchChatRequest)
+
+#include "bench_chatrequest.moc"
@@ -0,0 +1,117 @@
+#include "Logger.h"
+
+#include <QtTest>
+
+#include <cstdio>
+
+Q_LOGGING_CATEGORY(lcBench, "qmessage.bench")
+
+// Cost of a log call on the calling thread: queuing a record for the background writer, with
+// and without fields, a call in a disabled category, a suppressed repeat of the same text and
+// of the same call site, and Qt's synchronous handler for comparison. stderr goes to the null
+// device so that writing doesn't skew the numbers of the synchronous handler.
+class BenchLogger : public QObject {
+
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void queuedMessage();
+    void queuedMessageWithFields();
+    void disabledCategory();
+    void suppressedRepeat();
+    void suppressedRepeatByCallSite();
+    void synchronousMessage();
+
+private:
+    Logger *m_logger = nullptr;
+};
+
+void BenchLogger::initTestCase()
+{
+#ifdef Q_OS_WIN
+    QVERIFY(std::freopen("NUL", "w", stderr));
+#else
+    QVERIFY(std::freopen("/dev/null", "w", stderr));
+#endif
+
+    m_logger = Logger::instance();
+    // Large enough that the flusher keeps up and the benchmark measures queuing, not dropping.
+    m_logger->setBufferSize(1 << 20);
+    m_logger->setRepeatLimit(0);
+    m_logger->setFilterRules(QStringLiteral("qmessage.bench.debug=false"));
+    m_logger->start();
+}
+
+void BenchLogger::cleanupTestCase()
+{
+    m_logger->stop();
+}
+
+void BenchLogger::queuedMessage()
+{
+    int request = 0;
+    QBENCHMARK {
+        qCInfo(lcBench) << "Handled request" << ++request << "from" << QStringLiteral("127.0.0.1");
+    }
+}
+
+void BenchLogger::queuedMessageWithFields()
+{
+    int request = 0;
+    QBENCHMARK {
+        qCInfo(lcBench) << "Handled request" << LogField("request", ++request) << LogField("peer", QStringLiteral("127.0.0.1"));
+    }
+}
+
+void BenchLogger::disabledCategory()
+{
+    int request = 0;
+    QBENCHMARK {
+        qCDebug(lcBench) << "Handled request" << ++request;
+    }
+}
+
+void BenchLogger::suppressedRepeat()
+{
+    m_logger->setRepeatLimit(20);
+
+    QBENCHMARK {
+        qCWarning(lcBench) << "Handshake failed";
+    }
+
+    m_logger->setRepeatLimit(0);
+}
+
+void BenchLogger::suppressedRepeatByCallSite()
+{
+    m_logger->setRepeatLimit(20);
+    m_logger->setRepeatsByCallSite(true);
+
+    int request = 0;
+    QBENCHMARK {
+        qCWarning(lcBench) << "Handshake failed" << ++request;
+    }
+
+    m_logger->setRepeatsByCallSite(false);
+    m_logger->setRepeatLimit(0);
+}
+
+void BenchLogger::synchronousMessage()
+{
+    m_logger->stop();
+    // Qt's default handler, not the one Qt Test installs.
+    const QtMessageHandler testHandler = qInstallMessageHandler(nullptr);
+
+    int request = 0;
+    QBENCHMARK {
+        qCInfo(lcBench) << "Handled request" << ++request << "from" << QStringLiteral("127.0.0.1");
+    }
+
+    qInstallMessageHandler(testHandler);
+}
+
+QTEST_GUILESS_MAIN(BenchLogger)
+
+#include "bench_logger.moc"
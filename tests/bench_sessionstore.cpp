@@ -0,0 +1,196 @@
+#include "SessionStore.h"
+#include "User.h"
+#include "UserManager.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QSignalSpy>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <QtTest>
+
+// Startup cost of the session store: writing a snapshot of every session, then restoring it
+// (and a journal on top of it) into a freshly loaded user table, as a restart does. Also the
+// longest the event loop stalls while a periodic snapshot is written, on the loop itself and
+// from the worker thread. The number of sessions defaults to one million and can be set with
+// QMESSAGE_BENCH_SESSIONS.
+class BenchSessionStore : public QObject {
+
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void snapshot();
+    void snapshotWhileServing_data();
+    void snapshotWhileServing();
+    void loadSnapshot();
+    void loadSnapshotAndJournal();
+
+private:
+    void clearSessions();
+
+private:
+    QTemporaryDir m_directory;
+    UserManager *m_userManager = nullptr;
+    int m_sessions = 1000000;
+};
+
+void BenchSessionStore::initTestCase()
+{
+    QVERIFY(m_directory.isValid());
+    // The user database is created in the working directory.
+    QDir::setCurrent(m_directory.path());
+
+    const QByteArray sessions = qgetenv("QMESSAGE_BENCH_SESSIONS");
+    if (!sessions.isEmpty()) {
+        m_sessions = sessions.toInt();
+    }
+
+    m_userManager = new UserManager(this);
+
+    QSqlDatabase database = QSqlDatabase::database();
+    database.transaction();
+
+    QSqlQuery query;
+    query.prepare("INSERT INTO users (id, name, password) VALUES (:id, :name, :password)");
+    for (int i = 0; i < m_sessions; ++i) {
+        const QString id = QStringLiteral("u%1").arg(i, 7, 10, QLatin1Char('0'));
+        query.bindValue(":id", id);
+        query.bindValue(":name", QStringLiteral("user") + id);
+        query.bindValue(":password", QStringLiteral("x"));
+        QVERIFY(query.exec());
+    }
+
+    database.commit();
+
+    m_userManager->loadUsers();
+    QCOMPARE(m_userManager->users().size(), m_sessions);
+
+    // A typical RSA public key in PEM form.
+    const QString publicKey = QString(450, QLatin1Char('k'));
+    const QDateTime now = QDateTime::currentDateTime();
+    for (User *user : m_userManager->users()) {
+        user->setToken(user->id() + QStringLiteral(".1700000000000.1900000000.1.0123456789abcdef.") + QString(43, QLatin1Char('m')));
+        user->setLastActive(now);
+        user->setPublicKey(publicKey);
+    }
+}
+
+void BenchSessionStore::snapshot()
+{
+    SessionStore store(m_userManager);
+    store.setPath(m_directory.filePath("sessions.snapshot"));
+
+    bool written = false;
+    QBENCHMARK_ONCE {
+        written = store.snapshot();
+    }
+
+    QVERIFY(written);
+    qDebug() << "Snapshot size:" << QFileInfo(m_directory.filePath("sessions.snapshot")).size() << "bytes";
+}
+
+void BenchSessionStore::snapshotWhileServing_data()
+{
+    QTest::addColumn<bool>("background");
+
+    QTest::newRow("event loop") << false;
+    QTest::newRow("worker thread") << true;
+}
+
+void BenchSessionStore::snapshotWhileServing()
+{
+    QFETCH(bool, background);
+
+    SessionStore store(m_userManager);
+    store.setPath(m_directory.filePath("sessions.serving"));
+    QSignalSpy written(&store, &SessionStore::snapshotWritten);
+
+    // Stands in for the requests being served. The longest gap between the ticks of a 1 ms
+    // timer is the longest a client waits for an answer.
+    QElapsedTimer clock;
+    qint64 lastTick = 0;
+    qint64 longestStall = 0;
+
+    QTimer ticker;
+    ticker.setTimerType(Qt::PreciseTimer);
+    ticker.setInterval(1);
+    connect(&ticker, &QTimer::timeout, this, [&clock, &lastTick, &longestStall]() {
+        const qint64 now = clock.elapsed();
+        longestStall = qMax(longestStall, now - lastTick);
+        lastTick = now;
+    });
+
+    clock.start();
+    ticker.start();
+
+    QTimer::singleShot(10, &store, [&store, background]() {
+        if (background) {
+            store.snapshotInBackground();
+        } else {
+            store.snapshot();
+        }
+    });
+
+    QVERIFY(written.wait(600000));
+    QVERIFY(written.first().first().toBool());
+
+    QTest::qWait(10);
+    ticker.stop();
+
+    QTest::setBenchmarkResult(longestStall, QTest::WalltimeMilliseconds);
+}
+
+void BenchSessionStore::loadSnapshot()
+{
+    clearSessions();
+
+    SessionStore store(m_userManager);
+    store.setPath(m_directory.filePath("sessions.snapshot"));
+
+    QBENCHMARK_ONCE {
+        QVERIFY(store.load());
+    }
+
+    QVERIFY(!m_userManager->users().last()->token().isEmpty());
+}
+
+void BenchSessionStore::loadSnapshotAndJournal()
+{
+    // A tenth of the sessions changed since the snapshot.
+    QByteArray journal;
+    const QList<User *> &users = m_userManager->users();
+    for (int i = 0; i < users.size(); i += 10) {
+        journal += SessionStore::encode(QList<User *>() << users.at(i));
+    }
+
+    QFile journalFile(m_directory.filePath("sessions.snapshot.journal"));
+    QVERIFY(journalFile.open(QIODevice::WriteOnly));
+    journalFile.write(journal);
+    journalFile.close();
+
+    clearSessions();
+
+    SessionStore store(m_userManager);
+    store.setPath(m_directory.filePath("sessions.snapshot"));
+    store.setJournalEnabled(true);
+
+    QBENCHMARK_ONCE {
+        QVERIFY(store.load());
+    }
+
+    QVERIFY(!m_userManager->users().last()->token().isEmpty());
+}
+
+void BenchSessionStore::clearSessions()
+{
+    for (User *user : m_userManager->users()) {
+        user->setToken(QString());
+    }
+}
+
+QTEST_GUILESS_MAIN(BenchSessionStore)
+
+#include "bench_sessionstore.moc"
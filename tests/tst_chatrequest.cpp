@@ -0,0 +1,162 @@
+#include "ChatRequest.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QtTest>
+
+// The single-pass decoder must either yield exactly what QJsonDocument yields or hand the
+// input over to it, so every input is decoded both ways and compared.
+class TestChatRequest : public QObject {
+
+    Q_OBJECT
+
+private slots:
+    void validRequests_data();
+    void validRequests();
+    void fallsBackOnInvalidUtf8_data();
+    void fallsBackOnInvalidUtf8();
+    void randomInputs();
+    void mutatedInputs();
+
+private:
+    static ChatRequest genericDecode(const QByteArray &json);
+    static void compareWithGeneric(const QByteArray &json);
+};
+
+namespace {
+
+const char *const seedRequests[] = {
+    R"({"action":3,"token":"abc.123","target":"x1Y2z3","message":"hello"})",
+    R"({"action":0,"name":"alice","password":"secret","pubKey":"-----BEGIN KEY-----\nAAAA\n-----END KEY-----"})",
+    R"({ "action" : 10 , "cursor" : "bob" , "limit" : 50 , "token" : "t" })",
+    R"({"action":4,"token":"t","lastSeq":-1,"extra":{"nested":[1,2.5e3,true,false,null,"s"]}})",
+    R"({"action":13,"token":"t","target":"u","name":"file.bin","size":123456})",
+    R"({"message":"café 😀 \"quoted\" \\ \/ \b\f\n\r\t","action":3})",
+    "{\"message\":\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80\",\"action\":3}",
+    R"({})",
+    R"({"action":1.5,"limit":1e2,"size":12345678901})",
+    R"({"action":3,"action":4})",
+};
+
+}
+
+ChatRequest TestChatRequest::genericDecode(const QByteArray &json)
+{
+    return ChatRequest::fromJsonObject(QJsonDocument::fromJson(json).object());
+}
+
+void TestChatRequest::compareWithGeneric(const QByteArray &json)
+{
+    const ChatRequest fast = ChatRequest::fromJson(json);
+    const ChatRequest generic = genericDecode(json);
+
+    for (int field = ChatRequest::Action; field < ChatRequest::FieldCount; ++field) {
+        const auto f = static_cast<ChatRequest::Field>(field);
+        if (fast.hasValue(f) != generic.hasValue(f)) {
+            QFAIL(qPrintable(QStringLiteral("hasValue(%1) differs for %2").arg(field).arg(QString::fromLatin1(json.toPercentEncoding()))));
+        }
+        if (fast.value(f) != generic.value(f)) {
+            QFAIL(qPrintable(QStringLiteral("value(%1) differs for %2").arg(field).arg(QString::fromLatin1(json.toPercentEncoding()))));
+        }
+    }
+
+    if (fast.action() != generic.action() || fast.limit() != generic.limit() || fast.lastSeq() != generic.lastSeq()
+            || fast.size() != generic.size() || fast.credit() != generic.credit()) {
+        QFAIL(qPrintable(QStringLiteral("integers differ for %1").arg(QString::fromLatin1(json.toPercentEncoding()))));
+    }
+}
+
+void TestChatRequest::validRequests_data()
+{
+    QTest::addColumn<QByteArray>("json");
+
+    for (const char *request : seedRequests) {
+        QTest::newRow(request) << QByteArray(request);
+    }
+}
+
+void TestChatRequest::validRequests()
+{
+    QFETCH(QByteArray, json);
+
+    compareWithGeneric(json);
+}
+
+void TestChatRequest::fallsBackOnInvalidUtf8_data()
+{
+    QTest::addColumn<QByteArray>("json");
+
+    QTest::newRow("stray continuation") << QByteArray("{\"message\":\"a\x80z\"}");
+    QTest::newRow("invalid lead") << QByteArray("{\"message\":\"\xff\"}");
+    QTest::newRow("overlong") << QByteArray("{\"message\":\"\xc0\xaf\"}");
+    QTest::newRow("overlong 3 bytes") << QByteArray("{\"message\":\"\xe0\x80\xaf\"}");
+    QTest::newRow("surrogate") << QByteArray("{\"message\":\"\xed\xa0\x80\"}");
+    QTest::newRow("above U+10FFFF") << QByteArray("{\"message\":\"\xf4\x90\x80\x80\"}");
+    QTest::newRow("truncated") << QByteArray("{\"message\":\"\xe2\x82\"}");
+    QTest::newRow("in unknown key") << QByteArray("{\"\xc3\":1,\"action\":3}");
+}
+
+void TestChatRequest::fallsBackOnInvalidUtf8()
+{
+    QFETCH(QByteArray, json);
+
+    ChatRequest request;
+    QVERIFY(!ChatRequest::decode(json, request));
+    compareWithGeneric(json);
+}
+
+void TestChatRequest::randomInputs()
+{
+    QRandomGenerator random(27);
+
+    // Biased towards JSON punctuation so that some inputs get past the first byte.
+    const QByteArray alphabet = QByteArrayLiteral("{}[]\":,\\ u0123456789abcdeftrnlsx-.+E\x80\xbf\xc3\xe2\xf0\xff");
+
+    for (int i = 0; i < 20000; ++i) {
+        QByteArray json("{");
+        const int length = random.bounded(64);
+        for (int j = 0; j < length; ++j) {
+            json.append(alphabet.at(random.bounded(alphabet.size())));
+        }
+
+        compareWithGeneric(json);
+        if (QTest::currentTestFailed()) {
+            return;
+        }
+    }
+}
+
+void TestChatRequest::mutatedInputs()
+{
+    QRandomGenerator random(42);
+
+    for (int i = 0; i < 50000; ++i) {
+        QByteArray json(seedRequests[random.bounded(static_cast<int>(sizeof(seedRequests) / sizeof(seedRequests[0])))]);
+
+        const int mutations = 1 + random.bounded(3);
+        for (int j = 0; j < mutations && !json.isEmpty(); ++j) {
+            const int pos = random.bounded(json.size());
+            switch (random.bounded(3)) {
+            case 0:
+                json[pos] = static_cast<char>(random.bounded(256));
+                break;
+            case 1:
+                json.insert(pos, static_cast<char>(random.bounded(256)));
+                break;
+            default:
+                json.remove(pos, 1);
+                break;
+            }
+        }
+
+        compareWithGeneric(json);
+        if (QTest::currentTestFailed()) {
+            return;
+        }
+    }
+}
+
+QTEST_APPLESS_MAIN(TestChatRequest)
+
+#include "tst_chatrequest.moc"
@@ -0,0 +1,109 @@
+#include "ConnectionRegistry.h"
+
+#include <algorithm>
+
+#include <QDateTime>
+#include <QHostAddress>
+#include <QPointer>
+#include <QWebSocket>
+#include <QWebSocketServer>
+#include <QtTest>
+
+// Connect/disconnect soak: batches of clients connect to a local server and close again. Slots
+// must be recycled and sockets deleted, so the registry never grows past its first slab however
+// many connections come and go. The number of connections defaults to 20000 and can be set
+// with QMESSAGE_SOAK_CONNECTIONS.
+class TestConnectionRegistry : public QObject {
+
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void soak();
+
+private:
+    QWebSocketServer *m_server = nullptr;
+    ConnectionRegistry *m_registry = nullptr;
+    QList<QPointer<QWebSocket>> m_accepted;
+    int m_closed = 0;
+    int m_connections = 20000;
+};
+
+namespace {
+
+const int batchSize = 100;
+
+}
+
+void TestConnectionRegistry::initTestCase()
+{
+    const QByteArray connections = qgetenv("QMESSAGE_SOAK_CONNECTIONS");
+    if (!connections.isEmpty()) {
+        m_connections = connections.toInt();
+    }
+
+    m_server = new QWebSocketServer(QStringLiteral("soak"), QWebSocketServer::NonSecureMode, this);
+    QVERIFY(m_server->listen(QHostAddress::LocalHost));
+
+    m_registry = new ConnectionRegistry(this);
+    connect(m_registry, &ConnectionRegistry::connectionClosed, this, [this]() {
+        ++m_closed;
+    });
+
+    connect(m_server, &QWebSocketServer::newConnection, this, [this]() {
+        while (QWebSocket *socket = m_server->nextPendingConnection()) {
+            m_registry->open(socket);
+            m_accepted.append(socket);
+        }
+    });
+}
+
+void TestConnectionRegistry::soak()
+{
+    const QUrl url(QStringLiteral("ws://127.0.0.1:%1").arg(m_server->serverPort()));
+    int capacity = 0;
+    int opened = 0;
+
+    while (opened < m_connections) {
+        const int batch = qMin(batchSize, m_connections - opened);
+
+        QList<QWebSocket *> clients;
+        for (int i = 0; i < batch; ++i) {
+            QWebSocket *client = new QWebSocket();
+            client->open(url);
+            clients.append(client);
+        }
+
+        QTRY_COMPARE_WITH_TIMEOUT(m_registry->count(), batch, 10000);
+
+        for (QWebSocket *client : clients) {
+            client->close();
+        }
+
+        QTRY_COMPARE_WITH_TIMEOUT(m_registry->count(), 0, 10000);
+        // Sockets are deleted once they disconnected.
+        QTRY_VERIFY_WITH_TIMEOUT(std::all_of(m_accepted.cbegin(), m_accepted.cend(), [](const QPointer<QWebSocket> &socket) {
+            return socket.isNull();
+        }), 10000);
+
+        qDeleteAll(clients);
+        m_accepted.clear();
+        opened += batch;
+
+        if (capacity == 0) {
+            capacity = m_registry->capacity();
+        }
+        QCOMPARE(m_registry->capacity(), capacity);
+    }
+
+    QCOMPARE(m_closed, m_connections);
+    QCOMPARE(capacity, 256);
+
+    // The latest activity outlives the connections it came from.
+    QVERIFY(m_registry->lastActivity() > 0);
+    QVERIFY(m_registry->lastActivity() <= QDateTime::currentMSecsSinceEpoch());
+}
+
+QTEST_GUILESS_MAIN(TestConnectionRegistry)
+
+#include "tst_connectionregistry.moc"
@@ -0,0 +1,220 @@
+#include "ChatServer.h"
+#include "HttpServer.h"
+
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+#include <QWebSocket>
+#include <QtTest>
+
+// With contact presence a user's presence changes reach the users subscribed to it and nobody
+// else. Runs a server on a local port and talks to it over WebSockets like the frontend does.
+class TestPresence : public QObject {
+
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanup();
+    void parsesPresenceMode();
+    void subscribersOnly();
+
+private:
+    QWebSocket *connectClient();
+    QString registerUser(QWebSocket *client, const QString &name);
+    QString userId(const QString &name) const;
+    void send(QWebSocket *client, const QJsonObject &request);
+    QList<QJsonObject> presenceEvents(QWebSocket *client) const;
+
+private:
+    QTemporaryDir m_directory;
+    ChatServer *m_server = nullptr;
+    QHash<QWebSocket*, QList<QJsonObject>> m_received;
+};
+
+void TestPresence::initTestCase()
+{
+    QVERIFY(m_directory.isValid());
+    // The user database is created in the working directory.
+    QDir::setCurrent(m_directory.path());
+
+    m_server = new ChatServer(this);
+    m_server->setPresenceMode(ChatServer::ContactPresence);
+    m_server->start(QStringLiteral("127.0.0.1"), 0, 0, 0, true, true);
+    QVERIFY(m_server->serverPort() != 0);
+}
+
+void TestPresence::cleanup()
+{
+    for (QWebSocket *client : m_received.keys()) {
+        client->abort();
+        client->deleteLater();
+    }
+    m_received.clear();
+}
+
+void TestPresence::parsesPresenceMode()
+{
+    bool ok = false;
+    QCOMPARE(ChatServer::presenceModeFromString(QStringLiteral("contacts"), &ok), ChatServer::ContactPresence);
+    QVERIFY(ok);
+    QCOMPARE(ChatServer::presenceModeFromString(QStringLiteral("broadcast"), &ok), ChatServer::BroadcastPresence);
+    QVERIFY(ok);
+    QCOMPARE(ChatServer::presenceModeFromString(QStringLiteral("directory"), &ok), ChatServer::DirectoryPresence);
+    QVERIFY(ok);
+    QCOMPARE(ChatServer::presenceModeFromString(QStringLiteral("contact"), &ok), ChatServer::BroadcastPresence);
+    QVERIFY(!ok);
+}
+
+void TestPresence::subscribersOnly()
+{
+    QWebSocket *alice = connectClient();
+    QWebSocket *bob = connectClient();
+    QWebSocket *carol = connectClient();
+
+    const QString aliceToken = registerUser(alice, QStringLiteral("alice"));
+    const QString bobToken = registerUser(bob, QStringLiteral("bob"));
+    QVERIFY(!aliceToken.isEmpty());
+    QVERIFY(!bobToken.isEmpty());
+    QVERIFY(!registerUser(carol, QStringLiteral("carol")).isEmpty());
+
+    const QString bobId = userId(QStringLiteral("bob"));
+    QVERIFY(!bobId.isEmpty());
+
+    // Alice subscribes to Bob, Carol doesn't.
+    m_received[alice].clear();
+    send(alice, QJsonObject {
+        { "action", HttpServer::SubscribePresenceRequest },
+        { "token", aliceToken },
+        { "target", bobId },
+    });
+    QTRY_COMPARE(presenceEvents(alice).size(), 1);
+    QJsonArray users = presenceEvents(alice).first().value("users").toArray();
+    QCOMPARE(users.size(), 1);
+    QCOMPARE(users.first().toObject().value("id").toString(), bobId);
+    QVERIFY(users.first().toObject().value("online").toBool());
+
+    // Bob's connection drops, only his subscriber hears about it.
+    m_received[alice].clear();
+    m_received[carol].clear();
+    bob->close();
+
+    QTRY_COMPARE(presenceEvents(alice).size(), 1);
+    users = presenceEvents(alice).first().value("users").toArray();
+    QCOMPARE(users.size(), 1);
+    QCOMPARE(users.first().toObject().value("id").toString(), bobId);
+    QVERIFY(!users.first().toObject().value("online").toBool());
+
+    QTest::qWait(200);
+    QVERIFY(presenceEvents(carol).isEmpty());
+
+    // He comes back on a new connection.
+    m_received[alice].clear();
+    QWebSocket *bobAgain = connectClient();
+    send(bobAgain, QJsonObject {
+        { "action", HttpServer::AuthorizeRequest },
+        { "token", bobToken },
+    });
+
+    QTRY_COMPARE(presenceEvents(alice).size(), 1);
+    users = presenceEvents(alice).first().value("users").toArray();
+    QCOMPARE(users.size(), 1);
+    QVERIFY(users.first().toObject().value("online").toBool());
+
+    QTest::qWait(200);
+    QVERIFY(presenceEvents(carol).isEmpty());
+
+    // Once unsubscribed, Alice doesn't hear about him either.
+    m_received[alice].clear();
+    send(alice, QJsonObject {
+        { "action", HttpServer::UnsubscribePresenceRequest },
+        { "token", aliceToken },
+        { "target", bobId },
+    });
+    QTRY_COMPARE(presenceEvents(alice).size(), 1);
+    QCOMPARE(presenceEvents(alice).first().value("removed").toArray(), QJsonArray { bobId });
+
+    m_received[alice].clear();
+    bobAgain->close();
+
+    QTest::qWait(200);
+    QVERIFY(presenceEvents(alice).isEmpty());
+    QVERIFY(presenceEvents(carol).isEmpty());
+}
+
+QWebSocket *TestPresence::connectClient()
+{
+    QWebSocket *client = new QWebSocket();
+    m_received.insert(client, QList<QJsonObject>());
+
+    connect(client, &QWebSocket::textMessageReceived, this, [this, client](const QString &message) {
+        m_received[client].append(QJsonDocument::fromJson(message.toUtf8()).object());
+    });
+
+    client->open(QUrl(QStringLiteral("ws://127.0.0.1:%1").arg(m_server->serverPort())));
+    if (!QTest::qWaitFor([client]() { return client->state() == QAbstractSocket::ConnectedState; }, 5000)) {
+        qWarning() << "Couldn't connect to the chat server";
+    }
+
+    return client;
+}
+
+QString TestPresence::registerUser(QWebSocket *client, const QString &name)
+{
+    m_received[client].clear();
+    send(client, QJsonObject {
+        { "action", HttpServer::RegisterRequest },
+        { "name", name },
+        { "password", QStringLiteral("secret") },
+    });
+
+    // The login response is followed by the presence snapshot, both have to be in before the
+    // caller starts counting presence events.
+    const bool answered = QTest::qWaitFor([this, client]() {
+        return !presenceEvents(client).isEmpty();
+    }, 5000);
+    if (!answered) {
+        return QString();
+    }
+
+    for (const QJsonObject &event : m_received.value(client)) {
+        if (event.value("event").toInt() == HttpServer::LoginEvent) {
+            return event.value("token").toString();
+        }
+    }
+
+    return QString();
+}
+
+QString TestPresence::userId(const QString &name) const
+{
+    QSqlQuery query;
+    query.prepare("SELECT id FROM users WHERE name = :name");
+    query.bindValue(":name", name);
+
+    return query.exec() && query.next() ? query.value(0).toString() : QString();
+}
+
+void TestPresence::send(QWebSocket *client, const QJsonObject &request)
+{
+    client->sendTextMessage(QString::fromUtf8(QJsonDocument(request).toJson(QJsonDocument::Compact)));
+}
+
+QList<QJsonObject> TestPresence::presenceEvents(QWebSocket *client) const
+{
+    QList<QJsonObject> events;
+    for (const QJsonObject &event : m_received.value(client)) {
+        if (event.value("event").toInt() == HttpServer::PresenceEvent) {
+            events.append(event);
+        }
+    }
+
+    return events;
+}
+
+QTEST_GUILESS_MAIN(TestPresence)
+
+#include "tst_presence.moc"
@@ -0,0 +1,286 @@
+#include "ChatServer.h"
+#include "HttpServer.h"
+
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+#include <QWebSocket>
+#include <QtTest>
+
+// Creating, joining, leaving and posting to rooms: posts reach every member and nobody else,
+// and a member whose session ends leaves its rooms. Runs a server on a local port and talks to
+// it over WebSockets like the frontend does.
+class TestRooms : public QObject {
+
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanup();
+    void createJoinPostLeave();
+    void logoutLeavesRooms();
+
+private:
+    QWebSocket *connectClient();
+    QString registerUser(QWebSocket *client, const QString &name);
+    QString userId(const QString &name) const;
+    void send(QWebSocket *client, const QJsonObject &request);
+    QList<QJsonObject> events(QWebSocket *client, int event) const;
+    QJsonObject roomOf(QWebSocket *client) const;
+
+private:
+    QTemporaryDir m_directory;
+    ChatServer *m_server = nullptr;
+    QHash<QWebSocket*, QList<QJsonObject>> m_received;
+};
+
+void TestRooms::initTestCase()
+{
+    QVERIFY(m_directory.isValid());
+    // The user database is created in the working directory.
+    QDir::setCurrent(m_directory.path());
+
+    m_server = new ChatServer(this);
+    m_server->start(QStringLiteral("127.0.0.1"), 0, 0, 0, true, true);
+    QVERIFY(m_server->serverPort() != 0);
+}
+
+void TestRooms::cleanup()
+{
+    for (QWebSocket *client : m_received.keys()) {
+        client->abort();
+        client->deleteLater();
+    }
+    m_received.clear();
+}
+
+void TestRooms::createJoinPostLeave()
+{
+    QWebSocket *alice = connectClient();
+    QWebSocket *bob = connectClient();
+    QWebSocket *carol = connectClient();
+
+    const QString aliceToken = registerUser(alice, QStringLiteral("alice"));
+    const QString bobToken = registerUser(bob, QStringLiteral("bob"));
+    const QString carolToken = registerUser(carol, QStringLiteral("carol"));
+    QVERIFY(!aliceToken.isEmpty());
+    QVERIFY(!bobToken.isEmpty());
+    QVERIFY(!carolToken.isEmpty());
+
+    const QString aliceId = userId(QStringLiteral("alice"));
+    const QString bobId = userId(QStringLiteral("bob"));
+
+    // The owner is the first member.
+    send(alice, QJsonObject {
+        { "action", HttpServer::CreateRoomRequest },
+        { "token", aliceToken },
+        { "name", QStringLiteral("lobby") },
+    });
+    QTRY_VERIFY(!roomOf(alice).isEmpty());
+    const QString roomId = roomOf(alice).value("id").toString();
+    QCOMPARE(roomOf(alice).value("owner").toString(), aliceId);
+    QCOMPARE(roomOf(alice).value("members").toArray(), QJsonArray { aliceId });
+
+    // A taken name is refused.
+    m_received[bob].clear();
+    send(bob, QJsonObject {
+        { "action", HttpServer::CreateRoomRequest },
+        { "token", bobToken },
+        { "name", QStringLiteral("Lobby") },
+    });
+    QTRY_COMPARE(events(bob, HttpServer::RoomEvent).size(), 1);
+    QVERIFY(!events(bob, HttpServer::RoomEvent).first().value("valid").toBool());
+
+    // Bob joins, Alice hears about it.
+    m_received[alice].clear();
+    m_received[bob].clear();
+    send(bob, QJsonObject {
+        { "action", HttpServer::JoinRoomRequest },
+        { "token", bobToken },
+        { "target", roomId },
+    });
+    QTRY_VERIFY(!roomOf(bob).isEmpty());
+    QCOMPARE(roomOf(bob).value("members").toArray().size(), 2);
+    QTRY_COMPARE(events(alice, HttpServer::RoomEvent).size(), 1);
+    QCOMPARE(events(alice, HttpServer::RoomEvent).first().value("joined").toString(), bobId);
+
+    // A post reaches both members with the same number, not Carol.
+    m_received[alice].clear();
+    m_received[bob].clear();
+    send(bob, QJsonObject {
+        { "action", HttpServer::RoomMessageRequest },
+        { "token", bobToken },
+        { "target", roomId },
+        { "message", QStringLiteral("hello") },
+    });
+    QTRY_COMPARE(events(alice, HttpServer::RoomMessageEvent).size(), 1);
+    QTRY_COMPARE(events(bob, HttpServer::RoomMessageEvent).size(), 1);
+    const QJsonObject post = events(alice, HttpServer::RoomMessageEvent).first();
+    QCOMPARE(post.value("message").toString(), QStringLiteral("hello"));
+    QCOMPARE(post.value("sender").toString(), bobId);
+    QCOMPARE(post.value("room").toString(), roomId);
+    QCOMPARE(events(bob, HttpServer::RoomMessageEvent).first().value("roomSeq"), post.value("roomSeq"));
+
+    QTest::qWait(200);
+    QVERIFY(events(carol, HttpServer::RoomMessageEvent).isEmpty());
+
+    // Non-members can't post.
+    m_received[alice].clear();
+    send(carol, QJsonObject {
+        { "action", HttpServer::RoomMessageRequest },
+        { "token", carolToken },
+        { "target", roomId },
+        { "message", QStringLiteral("let me in") },
+    });
+    QTest::qWait(200);
+    QVERIFY(events(alice, HttpServer::RoomMessageEvent).isEmpty());
+
+    // Bob leaves, Alice hears about it and he doesn't get posts any more.
+    m_received[alice].clear();
+    m_received[bob].clear();
+    send(bob, QJsonObject {
+        { "action", HttpServer::LeaveRoomRequest },
+        { "token", bobToken },
+        { "target", roomId },
+    });
+    QTRY_COMPARE(events(alice, HttpServer::RoomEvent).size(), 1);
+    QCOMPARE(events(alice, HttpServer::RoomEvent).first().value("left").toString(), bobId);
+    QTRY_COMPARE(events(bob, HttpServer::RoomEvent).size(), 1);
+
+    m_received[bob].clear();
+    send(alice, QJsonObject {
+        { "action", HttpServer::RoomMessageRequest },
+        { "token", aliceToken },
+        { "target", roomId },
+        { "message", QStringLiteral("bye") },
+    });
+    QTRY_COMPARE(events(alice, HttpServer::RoomMessageEvent).size(), 1);
+    QTest::qWait(200);
+    QVERIFY(events(bob, HttpServer::RoomMessageEvent).isEmpty());
+}
+
+void TestRooms::logoutLeavesRooms()
+{
+    QWebSocket *dave = connectClient();
+    QWebSocket *erin = connectClient();
+
+    const QString daveToken = registerUser(dave, QStringLiteral("dave"));
+    const QString erinToken = registerUser(erin, QStringLiteral("erin"));
+    QVERIFY(!daveToken.isEmpty());
+    QVERIFY(!erinToken.isEmpty());
+
+    const QString daveId = userId(QStringLiteral("dave"));
+    const QString erinId = userId(QStringLiteral("erin"));
+
+    send(dave, QJsonObject {
+        { "action", HttpServer::CreateRoomRequest },
+        { "token", daveToken },
+        { "name", QStringLiteral("garden") },
+    });
+    QTRY_VERIFY(!roomOf(dave).isEmpty());
+    const QString roomId = roomOf(dave).value("id").toString();
+
+    send(erin, QJsonObject {
+        { "action", HttpServer::JoinRoomRequest },
+        { "token", erinToken },
+        { "target", roomId },
+    });
+    QTRY_VERIFY(!roomOf(erin).isEmpty());
+
+    // Logging out ends the session, Erin sees Dave leave.
+    m_received[erin].clear();
+    send(dave, QJsonObject {
+        { "action", HttpServer::LogoutRequest },
+        { "token", daveToken },
+    });
+    QTRY_COMPARE(events(erin, HttpServer::RoomEvent).size(), 1);
+    QCOMPARE(events(erin, HttpServer::RoomEvent).first().value("left").toString(), daveId);
+
+    // The room goes on without him.
+    m_received[erin].clear();
+    send(erin, QJsonObject {
+        { "action", HttpServer::JoinRoomRequest },
+        { "token", erinToken },
+        { "target", roomId },
+    });
+    QTRY_VERIFY(!roomOf(erin).isEmpty());
+    QCOMPARE(roomOf(erin).value("members").toArray(), QJsonArray { erinId });
+}
+
+QWebSocket *TestRooms::connectClient()
+{
+    QWebSocket *client = new QWebSocket();
+    m_received.insert(client, QList<QJsonObject>());
+
+    connect(client, &QWebSocket::textMessageReceived, this, [this, client](const QString &message) {
+        m_received[client].append(QJsonDocument::fromJson(message.toUtf8()).object());
+    });
+
+    client->open(QUrl(QStringLiteral("ws://127.0.0.1:%1").arg(m_server->serverPort())));
+    if (!QTest::qWaitFor([client]() { return client->state() == QAbstractSocket::ConnectedState; }, 5000)) {
+        qWarning() << "Couldn't connect to the chat server";
+    }
+
+    return client;
+}
+
+QString TestRooms::registerUser(QWebSocket *client, const QString &name)
+{
+    m_received[client].clear();
+    send(client, QJsonObject {
+        { "action", HttpServer::RegisterRequest },
+        { "name", name },
+        { "password", QStringLiteral("secret") },
+    });
+
+    const bool answered = QTest::qWaitFor([this, client]() {
+        return !events(client, HttpServer::LoginEvent).isEmpty();
+    }, 5000);
+
+    return answered ? events(client, HttpServer::LoginEvent).first().value("token").toString() : QString();
+}
+
+QString TestRooms::userId(const QString &name) const
+{
+    QSqlQuery query;
+    query.prepare("SELECT id FROM users WHERE name = :name");
+    query.bindValue(":name", name);
+
+    return query.exec() && query.next() ? query.value(0).toString() : QString();
+}
+
+void TestRooms::send(QWebSocket *client, const QJsonObject &request)
+{
+    client->sendTextMessage(QString::fromUtf8(QJsonDocument(request).toJson(QJsonDocument::Compact)));
+}
+
+QList<QJsonObject> TestRooms::events(QWebSocket *client, int event) const
+{
+    QList<QJsonObject> matching;
+    for (const QJsonObject &received : m_received.value(client)) {
+        if (received.value("event").toInt() == event) {
+            matching.append(received);
+        }
+    }
+
+    return matching;
+}
+
+QJsonObject TestRooms::roomOf(QWebSocket *client) const
+{
+    // Replies to create and join carry the whole room, membership events only its id.
+    for (const QJsonObject &event : events(client, HttpServer::RoomEvent)) {
+        if (event.value("room").isObject()) {
+            return event.value("room").toObject();
+        }
+    }
+
+    return QJsonObject();
+}
+
+QTEST_GUILESS_MAIN(TestRooms)
+
+#include "tst_rooms.moc"
@@ -0,0 +1,221 @@
+#include "TokenRevocationList.h"
+#include "TokenSigner.h"
+#include "User.h"
+#include "UserManager.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QtTest>
+
+// Signing, checking, revoking and rotating session tokens, and the one session per user rule
+// built on them. The user database is created in a temporary working directory.
+class TestSessionTokens : public QObject {
+
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void signAndVerify();
+    void rejectsTampering();
+    void rejectsExpired();
+    void revocation();
+    void rotation();
+    void oneSessionPerUser();
+
+private:
+    void writeKeys(const QByteArray &keys);
+
+private:
+    QTemporaryDir m_directory;
+    QString m_keyFile;
+    UserManager *m_userManager = nullptr;
+};
+
+void TestSessionTokens::initTestCase()
+{
+    QVERIFY(m_directory.isValid());
+    QDir::setCurrent(m_directory.path());
+
+    // Opens the default database connection the revocation lists below share.
+    m_userManager = new UserManager(this);
+    m_keyFile = m_directory.filePath(QStringLiteral("tokens.keys"));
+}
+
+void TestSessionTokens::signAndVerify()
+{
+    TokenSigner signer;
+    const qint64 issuedAt = QDateTime::currentMSecsSinceEpoch();
+    const qint64 expiresAt = QDateTime::currentSecsSinceEpoch() + 60;
+
+    const QString token = signer.sign(QStringLiteral("abc123"), issuedAt, expiresAt);
+
+    TokenSigner::Claims claims;
+    QVERIFY(signer.verify(token, &claims));
+    QCOMPARE(claims.userId, QStringLiteral("abc123"));
+    QCOMPARE(claims.issuedAt, issuedAt);
+    QCOMPARE(claims.expiresAt, expiresAt);
+    QVERIFY(!claims.nonce.isEmpty());
+
+    // Tokens issued in the same msec still differ.
+    QVERIFY(signer.sign(QStringLiteral("abc123"), issuedAt, expiresAt) != token);
+
+    // Another process without the key can't check it.
+    TokenSigner other;
+    QVERIFY(!other.verify(token, nullptr));
+}
+
+void TestSessionTokens::rejectsTampering()
+{
+    TokenSigner signer;
+    const QString token = signer.sign(QStringLiteral("abc123"), QDateTime::currentMSecsSinceEpoch(),
+                                      QDateTime::currentSecsSinceEpoch() + 60);
+
+    QString otherUser = token;
+    otherUser.replace(0, 6, QStringLiteral("xyz789"));
+    QVERIFY(!signer.verify(otherUser, nullptr));
+
+    QString otherMac = token;
+    otherMac[otherMac.size() - 1] = otherMac.endsWith(QLatin1Char('A')) ? QLatin1Char('B') : QLatin1Char('A');
+    QVERIFY(!signer.verify(otherMac, nullptr));
+
+    QVERIFY(!signer.verify(token.left(token.lastIndexOf(QLatin1Char('.'))), nullptr));
+    QVERIFY(!signer.verify(QString(), nullptr));
+    QVERIFY(!signer.verify(QStringLiteral("load"), nullptr));
+}
+
+void TestSessionTokens::rejectsExpired()
+{
+    TokenSigner signer;
+    const qint64 now = QDateTime::currentSecsSinceEpoch();
+
+    QVERIFY(!signer.verify(signer.sign(QStringLiteral("abc123"), (now - 120) * 1000, now - 60), nullptr));
+    QVERIFY(!signer.verify(signer.sign(QStringLiteral("abc123"), now * 1000, now), nullptr));
+}
+
+void TestSessionTokens::revocation()
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const qint64 expiresAt = now / 1000 + 60;
+
+    TokenRevocationList revoked;
+    QVERIFY(!revoked.isRevoked(QStringLiteral("abc123"), now));
+
+    revoked.revoke(QStringLiteral("abc123"), now, expiresAt);
+    QVERIFY(revoked.isRevoked(QStringLiteral("abc123"), now - 1));
+    QVERIFY(!revoked.isRevoked(QStringLiteral("abc123"), now));
+    QVERIFY(!revoked.isRevoked(QStringLiteral("xyz789"), now - 1));
+
+    // An older mark doesn't bring back tokens revoked already.
+    revoked.revoke(QStringLiteral("abc123"), now - 1000, expiresAt);
+    QVERIFY(revoked.isRevoked(QStringLiteral("abc123"), now - 1));
+
+    // Another instance sharing the database sees the revocation.
+    TokenRevocationList other;
+    QVERIFY(other.isRevoked(QStringLiteral("abc123"), now - 1));
+    QVERIFY(!other.isRevoked(QStringLiteral("abc123"), now));
+
+    // Rows whose tokens have all expired are dropped.
+    other.revoke(QStringLiteral("old"), now, now / 1000 - 1);
+    TokenRevocationList reloaded;
+    QVERIFY(!reloaded.isRevoked(QStringLiteral("old"), now - 1));
+}
+
+void TestSessionTokens::rotation()
+{
+    TokenSigner signer;
+    QVERIFY(signer.setKeyFile(m_keyFile));
+
+    const qint64 issuedAt = QDateTime::currentMSecsSinceEpoch();
+    const qint64 expiresAt = QDateTime::currentSecsSinceEpoch() + 60;
+
+    TokenSigner::Claims claims;
+    const QString first = signer.sign(QStringLiteral("abc123"), issuedAt, expiresAt);
+    QVERIFY(signer.verify(first, &claims));
+    QCOMPARE(claims.keyId, 1u);
+
+    // A second process with the same file accepts the tokens.
+    TokenSigner other;
+    QVERIFY(other.setKeyFile(m_keyFile));
+    QVERIFY(other.verify(first, nullptr));
+
+    QFile file(m_keyFile);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray firstKey = file.readAll();
+    file.close();
+
+    // Appending a key makes it sign new tokens, the old ones still verify. setKeyFile()
+    // reloads right away instead of waiting for the file watcher.
+    writeKeys(firstKey + "2 " + QByteArray(32, 'k').toBase64() + '\n');
+    QVERIFY(signer.setKeyFile(m_keyFile));
+
+    const QString second = signer.sign(QStringLiteral("abc123"), issuedAt, expiresAt);
+    QVERIFY(signer.verify(second, &claims));
+    QCOMPARE(claims.keyId, 2u);
+    QVERIFY(signer.verify(first, nullptr));
+
+    // Once the old key is gone, so are its tokens.
+    writeKeys("2 " + QByteArray(32, 'k').toBase64() + '\n');
+    QVERIFY(signer.setKeyFile(m_keyFile));
+    QVERIFY(!signer.verify(first, nullptr));
+    QVERIFY(signer.verify(second, nullptr));
+
+    // A file without keys keeps the current ones.
+    writeKeys("# nothing here\n");
+    QVERIFY(!signer.setKeyFile(m_keyFile));
+    QVERIFY(signer.verify(second, nullptr));
+}
+
+void TestSessionTokens::oneSessionPerUser()
+{
+    QVERIFY(m_userManager->saveUser(QStringLiteral("alice"), QStringLiteral("secret")));
+    User *alice = m_userManager->findUserByName(QStringLiteral("alice"));
+    QVERIFY(alice);
+
+    const QString first = m_userManager->issueToken(alice);
+    QCOMPARE(m_userManager->findUserByToken(first), alice);
+
+    // Idle deauthorization only ends the session here, the next login revokes the token anyway.
+    m_userManager->deauthorizeUser(alice);
+    QVERIFY(alice->token().isEmpty());
+    QCOMPARE(m_userManager->findUserByToken(first), alice);
+
+    QTest::qWait(2);
+    const QString second = m_userManager->issueToken(alice);
+    QVERIFY(second != first);
+    QVERIFY(!m_userManager->findUserByToken(first));
+
+    // Requests don't move the session, even with a token it doesn't know.
+    QSignalSpy sessionChanged(m_userManager, &UserManager::sessionChanged);
+    alice->setToken(QString());
+    QCOMPARE(m_userManager->findUserByToken(second), alice);
+    m_userManager->authorizeUser(alice);
+    QVERIFY(alice->token().isEmpty());
+    QCOMPARE(sessionChanged.count(), 0);
+
+    // Authorizing with it resumes the session, an older token doesn't replace a newer one.
+    m_userManager->authorizeUser(alice, nullptr, second);
+    QCOMPARE(alice->token(), second);
+    QCOMPARE(sessionChanged.count(), 1);
+    m_userManager->authorizeUser(alice, nullptr, first);
+    QCOMPARE(alice->token(), second);
+    QCOMPARE(sessionChanged.count(), 1);
+
+    // Logging out revokes it everywhere.
+    QTest::qWait(2);
+    m_userManager->revokeTokens(alice);
+    QVERIFY(!m_userManager->findUserByToken(second));
+}
+
+void TestSessionTokens::writeKeys(const QByteArray &keys)
+{
+    QFile file(m_keyFile);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(keys);
+}
+
+QTEST_GUILESS_MAIN(TestSessionTokens)
+
+#include "tst_sessiontokens.moc"
@@ -0,0 +1,308 @@
+#include "LoadGenerator.h"
+#include "Logger.h"
+
+#include <QFile>
+#include <QHostAddress>
+#include <QTextStream>
+#include <QTimer>
+#include <QWebSocket>
+
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+namespace {
+
+const int rampIntervalMs = 10;
+const int tickIntervalMs = 10;
+// Connections still pending this long after the last one was opened are left out of the measurement.
+const int connectTimeoutMs = 30000;
+
+// The cheapest request which still goes through parsing, dispatch and token verification:
+// the token is rejected and the server answers with an InvalidUserEvent.
+const QString probeRequest = QStringLiteral("{\"action\":4,\"token\":\"load\"}");
+
+double percentileMs(const QVector<qint64> &sortedNs, double percentile)
+{
+    if (sortedNs.isEmpty()) {
+        return 0.0;
+    }
+
+    const int index = static_cast<int>((sortedNs.size() - 1) * percentile / 100.0);
+    return sortedNs.at(index) / 1e6;
+}
+
+}
+
+LoadGenerator::LoadGenerator(const Options &options, QObject *parent)
+    : QObject(parent)
+    , m_options(options)
+{
+    m_rampTimer = new QTimer(this);
+    m_rampTimer->setInterval(rampIntervalMs);
+    connect(m_rampTimer, &QTimer::timeout, this, &LoadGenerator::openMore);
+
+    m_tickTimer = new QTimer(this);
+    m_tickTimer->setInterval(tickIntervalMs);
+    m_tickTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_tickTimer, &QTimer::timeout, this, &LoadGenerator::tick);
+}
+
+void LoadGenerator::start()
+{
+    m_clients.resize(m_options.connections);
+    m_connectedOrder.reserve(m_options.connections);
+
+    m_clock.start();
+    m_rampTimer->start();
+    openMore();
+}
+
+void LoadGenerator::openMore()
+{
+    const int batch = qMax(1, m_options.rampPerSecond * rampIntervalMs / 1000);
+
+    for (int i = 0; i < batch && m_opened < m_options.connections; ++i, ++m_opened) {
+        const int index = m_opened;
+
+        QUrl url = m_options.url;
+        if (m_options.addresses > 1) {
+            url.setHost(QHostAddress(QHostAddress(QHostAddress::LocalHost).toIPv4Address() + static_cast<quint32>(index % m_options.addresses)).toString());
+        }
+
+        QWebSocket *socket = new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this);
+        m_clients[index].socket = socket;
+
+        connect(socket, &QWebSocket::connected, this, [this, index]() {
+            onConnected(index);
+        });
+        connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::error), this, [this, index]() {
+            onFailed(index);
+        });
+        connect(socket, &QWebSocket::textMessageReceived, this, [this, index]() {
+            onTextMessage(index);
+        });
+
+        socket->open(url);
+    }
+
+    if (m_opened < m_options.connections) {
+        return;
+    }
+
+    m_rampTimer->stop();
+    QTimer::singleShot(connectTimeoutMs, this, [this]() {
+        if (!m_measuring) {
+            qCWarning(lcCapture) << "Connections still pending after" << connectTimeoutMs << "ms, measuring anyway";
+            startMeasuring();
+        }
+    });
+}
+
+void LoadGenerator::onConnected(int index)
+{
+    m_clients[index].connected = true;
+    m_connectedOrder.append(index);
+
+    if (m_connectedOrder.size() + m_failed == m_options.connections) {
+        startMeasuring();
+    }
+}
+
+void LoadGenerator::onFailed(int index)
+{
+    Client &client = m_clients[index];
+    if (client.connected) {
+        qCWarning(lcCapture) << "Connection" << index << "dropped:" << client.socket->errorString();
+        client.connected = false;
+        return;
+    }
+
+    if (++m_failed == 1) {
+        qCWarning(lcCapture) << "Connection" << index << "failed:" << client.socket->errorString();
+    }
+
+    if (m_connectedOrder.size() + m_failed == m_options.connections) {
+        startMeasuring();
+    }
+}
+
+void LoadGenerator::onTextMessage(int index)
+{
+    Client &client = m_clients[index];
+    if (client.sentAtNs < 0) {
+        return;
+    }
+
+    if (m_measuring) {
+        m_latenciesNs.append(m_clock.nsecsElapsed() - client.sentAtNs);
+        ++m_responses;
+    }
+    client.sentAtNs = -1;
+}
+
+void LoadGenerator::startMeasuring()
+{
+    if (m_measuring) {
+        return;
+    }
+
+    m_measuring = true;
+    m_rampSeconds = m_clock.elapsed() / 1000.0;
+    m_measureStartNs = m_clock.nsecsElapsed();
+    m_lastTickNs = m_measureStartNs;
+    m_serverCpuStart = serverCpuSeconds();
+
+    if (!m_options.csv) {
+        qCInfo(lcCapture) << "Connected" << m_connectedOrder.size() << "of" << m_options.connections
+                          << "in" << m_rampSeconds << "s, measuring for" << m_options.durationSeconds << "s";
+    }
+
+    m_tickTimer->start();
+    QTimer::singleShot(m_options.durationSeconds * 1000, this, &LoadGenerator::finish);
+}
+
+void LoadGenerator::tick()
+{
+    const qint64 nowNs = m_clock.nsecsElapsed();
+    const int senders = m_options.mode == ActiveLoad ? m_connectedOrder.size()
+                                                     : qMin(m_options.probes, m_connectedOrder.size());
+    if (senders == 0) {
+        return;
+    }
+
+    // Requests due since the last tick, spread round-robin over the senders.
+    m_sendBudget += senders * m_options.rate * (nowNs - m_lastTickNs) / 1e9;
+    m_lastTickNs = nowNs;
+
+    for (; m_sendBudget >= 1.0; m_sendBudget -= 1.0) {
+        if (m_nextSender >= senders) {
+            m_nextSender = 0;
+        }
+
+        Client &client = m_clients[m_connectedOrder.at(m_nextSender++)];
+        if (!client.connected) {
+            continue;
+        }
+
+        // One request in flight per connection, a server falling behind shows up as skipped sends.
+        if (client.sentAtNs >= 0) {
+            ++m_skipped;
+            continue;
+        }
+
+        client.sentAtNs = nowNs;
+        client.socket->sendTextMessage(probeRequest);
+        ++m_requests;
+    }
+}
+
+void LoadGenerator::finish()
+{
+    m_tickTimer->stop();
+    m_measuredNs = m_clock.nsecsElapsed() - m_measureStartNs;
+    m_serverCpuEnd = serverCpuSeconds();
+
+    report();
+
+    for (const Client &client : qAsConst(m_clients)) {
+        if (client.socket) {
+            client.socket->abort();
+        }
+    }
+
+    emit finished();
+}
+
+void LoadGenerator::report()
+{
+    QVector<qint64> latencies = m_latenciesNs;
+    std::sort(latencies.begin(), latencies.end());
+
+    const double seconds = qMax<qint64>(1, m_measuredNs) / 1e9;
+    const double serverCpu = m_serverCpuStart >= 0 && m_serverCpuEnd >= 0
+            ? 100.0 * (m_serverCpuEnd - m_serverCpuStart) / seconds : -1.0;
+    const qint64 serverRss = serverRssKb();
+    const QString mode = m_options.mode == ActiveLoad ? QStringLiteral("active") : QStringLiteral("idle");
+
+    QTextStream out(stdout);
+
+    if (m_options.csv) {
+        out << mode << ',' << m_options.connections << ',' << m_connectedOrder.size() << ',' << m_failed << ','
+            << QString::number(m_rampSeconds, 'f', 1) << ',' << m_requests << ',' << m_responses << ',' << m_skipped << ','
+            << QString::number(percentileMs(latencies, 50), 'f', 3) << ','
+            << QString::number(percentileMs(latencies, 99), 'f', 3) << ','
+            << QString::number(percentileMs(latencies, 99.9), 'f', 3) << ','
+            << QString::number(serverCpu, 'f', 1) << ',' << serverRss << '\n';
+        return;
+    }
+
+    out << "mode:               " << mode << "\n"
+        << "connections:        " << m_connectedOrder.size() << " of " << m_options.connections << " (" << m_failed
+        << " failed, ramp " << QString::number(m_rampSeconds, 'f', 1) << " s)\n"
+        << "requests sent:      " << m_requests << " (" << QString::number(m_requests / seconds, 'f', 1) << "/s, "
+        << m_skipped << " skipped while one was outstanding)\n"
+        << "responses received: " << m_responses << "\n"
+        << "latency p50:        " << QString::number(percentileMs(latencies, 50), 'f', 3) << " ms\n"
+        << "latency p99:        " << QString::number(percentileMs(latencies, 99), 'f', 3) << " ms\n"
+        << "latency p99.9:      " << QString::number(percentileMs(latencies, 99.9), 'f', 3) << " ms\n";
+
+    if (serverCpu >= 0) {
+        out << "server cpu:         " << QString::number(serverCpu, 'f', 1) << " % of one core\n"
+            << "server rss:         " << serverRss / 1024 << " MiB\n";
+    }
+}
+
+double LoadGenerator::serverCpuSeconds() const
+{
+#ifdef Q_OS_LINUX
+    if (m_options.serverPid <= 0) {
+        return -1.0;
+    }
+
+    QFile file(QStringLiteral("/proc/%1/stat").arg(m_options.serverPid));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1.0;
+    }
+
+    // The command name may contain spaces, the fields are counted after its closing parenthesis.
+    const QByteArray stat = file.readAll();
+    const QList<QByteArray> fields = stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+    if (fields.size() < 13) {
+        return -1.0;
+    }
+
+    // utime and stime, fields 14 and 15 of the whole line.
+    const qint64 ticks = fields.at(11).toLongLong() + fields.at(12).toLongLong();
+
+    return static_cast<double>(ticks) / sysconf(_SC_CLK_TCK);
+#else
+    return -1.0;
+#endif
+}
+
+qint64 LoadGenerator::serverRssKb() const
+{
+#ifdef Q_OS_LINUX
+    if (m_options.serverPid <= 0) {
+        return -1;
+    }
+
+    QFile file(QStringLiteral("/proc/%1/status").arg(m_options.serverPid));
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return -1;
+    }
+
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine();
+        if (line.startsWith("VmRSS:")) {
+            return line.mid(6).trimmed().split(' ').first().toLongLong();
+        }
+    }
+
+#endif
+
+    return -1;
+}
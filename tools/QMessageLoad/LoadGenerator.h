@@ -0,0 +1,103 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QUrl>
+#include <QVector>
+
+class QTimer;
+class QWebSocket;
+
+// Holds a large number of WebSocket connections open against a server and measures how it copes:
+// either most of them idle while a few probes measure latency, or all of them sending requests
+// at a fixed rate. Connections are spread over several loopback addresses, one address only has
+// enough ephemeral ports for about 28000 of them. With the server's pid, its CPU time and
+// resident memory over the measurement are reported as well.
+class LoadGenerator : public QObject {
+
+    Q_OBJECT
+
+public:
+    enum Mode {
+        IdleLoad,
+        ActiveLoad
+    };
+
+    struct Options {
+        QUrl url;
+        int connections = 10000;
+        // Loopback addresses to spread the connections over, 127.0.0.1 onwards.
+        int addresses = 1;
+        Mode mode = IdleLoad;
+        // Requests per second of each sending connection.
+        double rate = 1.0;
+        // Connections which send in idle mode.
+        int probes = 100;
+        int durationSeconds = 30;
+        int rampPerSecond = 2000;
+        qint64 serverPid = 0;
+        bool csv = false;
+    };
+
+    explicit LoadGenerator(const Options &options, QObject *parent = nullptr);
+
+public slots:
+    void start();
+
+signals:
+    void finished();
+
+private slots:
+    void openMore();
+    void tick();
+
+private:
+    struct Client {
+        QWebSocket *socket = nullptr;
+        bool connected = false;
+        // When the outstanding request went out, -1 if none is.
+        qint64 sentAtNs = -1;
+    };
+
+    void onConnected(int index);
+    void onFailed(int index);
+    void onTextMessage(int index);
+    void startMeasuring();
+    void finish();
+    void report();
+
+    // utime + stime of the server in seconds, -1 without a pid.
+    double serverCpuSeconds() const;
+    qint64 serverRssKb() const;
+
+private:
+    Options m_options;
+
+    QVector<Client> m_clients;
+    // Connected clients in the order they connected, the senders are taken from the front.
+    QVector<int> m_connectedOrder;
+    int m_opened = 0;
+    int m_failed = 0;
+
+    QTimer *m_rampTimer = nullptr;
+    QTimer *m_tickTimer = nullptr;
+    QElapsedTimer m_clock;
+
+    bool m_measuring = false;
+    qint64 m_measureStartNs = 0;
+    qint64 m_lastTickNs = 0;
+    double m_rampSeconds = 0.0;
+    double m_sendBudget = 0.0;
+    int m_nextSender = 0;
+    double m_serverCpuStart = -1.0;
+    double m_serverCpuEnd = -1.0;
+
+    QVector<qint64> m_latenciesNs;
+    quint64 m_requests = 0;
+    quint64 m_skipped = 0;
+    quint64 m_responses = 0;
+    qint64 m_measuredNs = 0;
+};
+
+#endif // LOADGENERATOR_H
@@ -0,0 +1,86 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTimer>
+#include "LoadGenerator.h"
+#include "Logger.h"
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+
+    parser.setApplicationDescription("QMessageLoad holds many WebSocket connections open against QMessageServer and reports request latencies.");
+    parser.addHelpOption();
+
+    QCommandLineOption urlOption(QStringList() << "url",
+                                 "Set the WebSocket URL of the server.", "url", "ws://127.0.0.1:12345");
+    parser.addOption(urlOption);
+
+    QCommandLineOption connectionsOption(QStringList() << "connections",
+                                         "Set the number of connections.", "count", "10000");
+    parser.addOption(connectionsOption);
+
+    QCommandLineOption addressesOption(QStringList() << "addresses",
+                                       "Spread the connections over this many loopback addresses from 127.0.0.1 on.", "count", "1");
+    parser.addOption(addressesOption);
+
+    QCommandLineOption modeOption(QStringList() << "mode",
+                                  "Keep the connections idle while a few probes send (idle), or let all of them send (active).", "mode", "idle");
+    parser.addOption(modeOption);
+
+    QCommandLineOption rateOption(QStringList() << "rate",
+                                  "Set the requests per second of each sending connection.", "rate", "1");
+    parser.addOption(rateOption);
+
+    QCommandLineOption probesOption(QStringList() << "probes",
+                                    "Set the number of connections which send in idle mode.", "count", "100");
+    parser.addOption(probesOption);
+
+    QCommandLineOption durationOption(QStringList() << "duration",
+                                      "Set how many seconds to measure once the connections are open.", "seconds", "30");
+    parser.addOption(durationOption);
+
+    QCommandLineOption rampOption(QStringList() << "ramp",
+                                  "Set how many connections to open per second.", "count", "2000");
+    parser.addOption(rampOption);
+
+    QCommandLineOption serverPidOption(QStringList() << "serverPid",
+                                       "Report the CPU time and memory of this server process (Linux only).", "pid");
+    parser.addOption(serverPidOption);
+
+    QCommandLineOption csvOption(QStringList() << "csv",
+                                 "Print one comma separated line: mode, connections, connected, failed, ramp seconds, requests, responses, skipped, p50, p99 and p99.9 in ms, server CPU % and server RSS in KiB.");
+    parser.addOption(csvOption);
+
+    parser.process(app);
+
+    LoadGenerator::Options options;
+    options.url = QUrl(parser.value(urlOption));
+    options.connections = parser.value(connectionsOption).toInt();
+    options.addresses = qMax(1, parser.value(addressesOption).toInt());
+    options.rate = parser.value(rateOption).toDouble();
+    options.probes = parser.value(probesOption).toInt();
+    options.durationSeconds = parser.value(durationOption).toInt();
+    options.rampPerSecond = parser.value(rampOption).toInt();
+    options.serverPid = parser.value(serverPidOption).toLongLong();
+    options.csv = parser.isSet(csvOption);
+
+    if (parser.value(modeOption) == QLatin1String("active")) {
+        options.mode = LoadGenerator::ActiveLoad;
+    } else if (parser.value(modeOption) != QLatin1String("idle")) {
+        qCCritical(lcCapture) << "Unknown load mode" << parser.value(modeOption);
+        return 1;
+    }
+
+    if (!options.url.isValid() || options.connections <= 0 || options.rate <= 0 || options.durationSeconds <= 0
+            || options.rampPerSecond <= 0) {
+        parser.showHelp(1);
+    }
+
+    LoadGenerator generator(options);
+
+    QObject::connect(&generator, &LoadGenerator::finished, &app, &QCoreApplication::quit, Qt::QueuedConnection);
+    QTimer::singleShot(0, &generator, &LoadGenerator::start);
+
+    return app.exec();
+}
@@ -0,0 +1,308 @@
+#include "Replayer.h"
+#include "Logger.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QTimer>
+#include <QWebSocket>
+
+#include <algorithm>
+
+namespace {
+
+// How long to wait for responses after the last captured record went out.
+const int settleMs = 2000;
+
+double percentileMs(const QVector<qint64> &sortedNs, int percentile)
+{
+    if (sortedNs.isEmpty()) {
+        return 0.0;
+    }
+
+    const int index = (sortedNs.size() - 1) * percentile / 100;
+    return sortedNs.at(index) / 1e6;
+}
+
+}
+
+Replayer::Replayer(const QUrl &url, double speed, QObject *parent)
+    : QObject(parent)
+    , m_url(url)
+    , m_speed(speed)
+{
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_timer, &QTimer::timeout, this, &Replayer::dispatch);
+}
+
+bool Replayer::load(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCCritical(lcCapture) << "Couldn't open capture" << path << file.errorString();
+        return false;
+    }
+
+    if (!TrafficCapture::readHeader(&file, nullptr)) {
+        qCCritical(lcCapture) << path << "isn't a capture file or has an unsupported version";
+        return false;
+    }
+
+    qint64 timestampUs = 0;
+    TrafficCapture::Record record;
+    while (TrafficCapture::readRecord(&file, record, timestampUs)) {
+        m_records.append(record);
+    }
+
+    // A capture cut short by a crash simply ends early.
+    if (!file.atEnd()) {
+        qCWarning(lcCapture) << "Ignoring truncated record at offset" << file.pos() << "of" << path;
+    }
+
+    qCInfo(lcCapture) << "Loaded" << m_records.size() << "records from" << path;
+
+    return true;
+}
+
+void Replayer::setIgnoreSslErrors(bool ignore)
+{
+    m_ignoreSslErrors = ignore;
+}
+
+void Replayer::start()
+{
+    m_clock.start();
+    dispatch();
+}
+
+void Replayer::dispatch()
+{
+    const qint64 elapsedUs = m_clock.nsecsElapsed() / 1000;
+
+    while (m_next < m_records.size()) {
+        const TrafficCapture::Record &record = m_records.at(m_next);
+
+        // A speed of 0 sends everything as fast as the connections allow.
+        const qint64 dueUs = m_speed > 0 ? static_cast<qint64>(record.timestampUs / m_speed) : 0;
+        if (dueUs > elapsedUs) {
+            m_timer->start(static_cast<int>((dueUs - elapsedUs) / 1000));
+            return;
+        }
+
+        switch (record.type) {
+        case TrafficCapture::OpenRecord:
+            openClient(record.connectionId);
+            break;
+        case TrafficCapture::CloseRecord:
+            closeClient(record.connectionId);
+            break;
+        case TrafficCapture::FrameRecord:
+            sendFrame(record.connectionId, record);
+            break;
+        }
+
+        ++m_next;
+    }
+
+    QTimer::singleShot(settleMs, this, &Replayer::finish);
+}
+
+void Replayer::openClient(quint64 connectionId)
+{
+    Client client;
+    client.socket = new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this);
+    QWebSocket *socket = client.socket;
+
+    m_clients.insert(connectionId, client);
+
+    connect(socket, &QWebSocket::connected, this, [this, connectionId]() {
+        auto client = m_clients.find(connectionId);
+        if (client == m_clients.end()) {
+            return;
+        }
+
+        client->connected = true;
+
+        const QVector<TrafficCapture::Record> pending = client->pending;
+        client->pending.clear();
+        for (const TrafficCapture::Record &record : pending) {
+            send(*client, record);
+        }
+
+        if (client->closeRequested) {
+            client->socket->close();
+        }
+    });
+
+    connect(socket, &QWebSocket::textMessageReceived, this, [this, connectionId](const QString &message) {
+        onTextMessage(connectionId, message);
+    });
+
+    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::error), this, [this, connectionId, socket]() {
+        auto client = m_clients.find(connectionId);
+        if (client != m_clients.end() && !client->connected) {
+            qCWarning(lcCapture) << "Connection" << connectionId << "failed:" << socket->errorString();
+            ++m_failedConnections;
+            client->pending.clear();
+        }
+    });
+
+    if (m_ignoreSslErrors) {
+        connect(socket, &QWebSocket::sslErrors, socket, [socket]() {
+            socket->ignoreSslErrors();
+        });
+    }
+
+    socket->open(m_url);
+}
+
+void Replayer::closeClient(quint64 connectionId)
+{
+    auto client = m_clients.find(connectionId);
+    if (client == m_clients.end()) {
+        return;
+    }
+
+    if (client->connected) {
+        client->socket->close();
+    } else {
+        // Still connecting, the queued frames go out first.
+        client->closeRequested = true;
+    }
+}
+
+void Replayer::sendFrame(quint64 connectionId, const TrafficCapture::Record &record)
+{
+    auto client = m_clients.find(connectionId);
+    if (client == m_clients.end()) {
+        // The capture started while this connection was already open.
+        openClient(connectionId);
+        client = m_clients.find(connectionId);
+    }
+
+    if (client->connected) {
+        send(*client, record);
+    } else {
+        client->pending.append(record);
+    }
+}
+
+void Replayer::send(Client &client, const TrafficCapture::Record &record)
+{
+    if (client.sentAtNs < 0) {
+        client.sentAtNs = m_clock.nsecsElapsed();
+    }
+
+    // File chunks are captured by size only, the server answers the zeroed header with an error.
+    if (record.flags & TrafficCapture::BinaryPayload) {
+        client.socket->sendBinaryMessage(QByteArray(static_cast<int>(record.payloadSize), '\0'));
+
+        ++m_framesSent;
+        m_bytesSent += record.payloadSize;
+        return;
+    }
+
+    QByteArray frame = record.payload;
+
+    // Only the size survived redaction, keep the load on the server comparable.
+    if (frame.isEmpty() && record.payloadSize > 0) {
+        frame = QByteArray(static_cast<int>(record.payloadSize), ' ');
+        frame[0] = '{';
+        frame[frame.size() - 1] = '}';
+    }
+
+    const QByteArray rewritten = rewriteToken(client, frame);
+
+    client.socket->sendTextMessage(QString::fromUtf8(rewritten));
+
+    ++m_framesSent;
+    m_bytesSent += static_cast<quint64>(rewritten.size());
+}
+
+QByteArray Replayer::rewriteToken(Client &client, const QByteArray &frame)
+{
+    if (!frame.contains("\"token\"")) {
+        return frame;
+    }
+
+    QJsonObject request = QJsonDocument::fromJson(frame).object();
+    const QString capturedToken = request.value(QLatin1String("token")).toString();
+    if (capturedToken.isEmpty()) {
+        return frame;
+    }
+
+    // A connection which logged in during the replay teaches us the live token for the
+    // captured one, which also resolves it for later connections authorizing with it.
+    QString liveToken = m_tokens.value(capturedToken);
+    if (liveToken.isEmpty() && !client.token.isEmpty()) {
+        liveToken = client.token;
+        m_tokens.insert(capturedToken, liveToken);
+    }
+
+    if (liveToken.isEmpty()) {
+        return frame;
+    }
+
+    request[QLatin1String("token")] = liveToken;
+
+    return QJsonDocument(request).toJson(QJsonDocument::Compact);
+}
+
+void Replayer::onTextMessage(quint64 connectionId, const QString &message)
+{
+    auto client = m_clients.find(connectionId);
+    if (client == m_clients.end()) {
+        return;
+    }
+
+    ++m_responses;
+
+    if (client->sentAtNs >= 0) {
+        m_latenciesNs.append(m_clock.nsecsElapsed() - client->sentAtNs);
+        client->sentAtNs = -1;
+    }
+
+    if (message.contains(QLatin1String("\"token\""))) {
+        const QString token = QJsonDocument::fromJson(message.toUtf8()).object().value(QLatin1String("token")).toString();
+        if (!token.isEmpty()) {
+            client->token = token;
+        }
+    }
+}
+
+void Replayer::finish()
+{
+    if (m_done) {
+        return;
+    }
+    m_done = true;
+
+    for (const Client &client : qAsConst(m_clients)) {
+        client.socket->close();
+    }
+
+    report();
+
+    emit finished();
+}
+
+void Replayer::report()
+{
+    QVector<qint64> latencies = m_latenciesNs;
+    std::sort(latencies.begin(), latencies.end());
+
+    // Without the settle period, which isn't part of the captured workload.
+    const double seconds = qMax<qint64>(1, m_clock.elapsed() - settleMs) / 1000.0;
+
+    QTextStream out(stdout);
+    out << "connections:        " << m_clients.size() << " (" << m_failedConnections << " failed)\n"
+        << "frames sent:        " << m_framesSent << " (" << m_bytesSent << " bytes, "
+        << QString::number(m_framesSent / seconds, 'f', 1) << "/s)\n"
+        << "responses received: " << m_responses << "\n"
+        << "latency samples:    " << latencies.size() << "\n"
+        << "latency p50:        " << QString::number(percentileMs(latencies, 50), 'f', 3) << " ms\n"
+        << "latency p99:        " << QString::number(percentileMs(latencies, 99), 'f', 3) << " ms\n";
+}
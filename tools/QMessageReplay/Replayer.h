@@ -0,0 +1,82 @@
+#ifndef REPLAYER_H
+#define REPLAYER_H
+
+#include "TrafficCapture.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QUrl>
+#include <QVector>
+
+class QTimer;
+class QWebSocket;
+
+// Plays a capture written by the server's -capture option back against a live server. Every
+// captured connection gets its own WebSocket and frames are sent on the captured schedule,
+// compressed or stretched by the speed factor. Tokens handed out by the live server replace the
+// captured ones, so authenticated requests keep working against a fresh user database.
+class Replayer : public QObject {
+
+    Q_OBJECT
+
+public:
+    Replayer(const QUrl &url, double speed, QObject *parent = nullptr);
+
+    bool load(const QString &path);
+    void setIgnoreSslErrors(bool ignore);
+
+public slots:
+    void start();
+
+signals:
+    void finished();
+
+private slots:
+    void dispatch();
+
+private:
+    struct Client {
+        QWebSocket *socket = nullptr;
+        QVector<TrafficCapture::Record> pending;
+        bool connected = false;
+        bool closeRequested = false;
+        // Live token from the last response which carried one.
+        QString token;
+        // When the oldest unanswered frame went out, -1 if none is outstanding.
+        qint64 sentAtNs = -1;
+    };
+
+    void openClient(quint64 connectionId);
+    void closeClient(quint64 connectionId);
+    void sendFrame(quint64 connectionId, const TrafficCapture::Record &record);
+    void send(Client &client, const TrafficCapture::Record &record);
+    QByteArray rewriteToken(Client &client, const QByteArray &frame);
+    void onTextMessage(quint64 connectionId, const QString &message);
+    void finish();
+    void report();
+
+private:
+    QUrl m_url;
+    double m_speed = 1.0;
+    bool m_ignoreSslErrors = false;
+
+    QVector<TrafficCapture::Record> m_records;
+    int m_next = 0;
+
+    QHash<quint64, Client> m_clients;
+    // Captured token, or its pseudonym, to the token the live server issued for it.
+    QHash<QString, QString> m_tokens;
+
+    QTimer *m_timer = nullptr;
+    QElapsedTimer m_clock;
+
+    QVector<qint64> m_latenciesNs;
+    quint64 m_framesSent = 0;
+    quint64 m_bytesSent = 0;
+    quint64 m_responses = 0;
+    quint64 m_failedConnections = 0;
+    bool m_done = false;
+};
+
+#endif // REPLAYER_H
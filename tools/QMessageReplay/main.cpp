@@ -0,0 +1,52 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTimer>
+#include "Logger.h"
+#include "Replayer.h"
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+
+    parser.setApplicationDescription("QMessageReplay plays a traffic capture of QMessageServer back against a running server and reports response latencies.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("capture", "Capture file written with the server's -capture option.");
+
+    QCommandLineOption urlOption(QStringList() << "url",
+                                 "Set the WebSocket URL of the server.", "url", "ws://localhost:12345");
+    parser.addOption(urlOption);
+
+    QCommandLineOption speedOption(QStringList() << "speed",
+                                   "Replay speed relative to the capture, e.g. 1, 10, or 0 for as fast as possible.", "factor", "1");
+    parser.addOption(speedOption);
+
+    QCommandLineOption ignoreSslErrorsOption(QStringList() << "ignoreSslErrors",
+                                             "Accept self-signed certificates on wss:// URLs.");
+    parser.addOption(ignoreSslErrorsOption);
+
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+
+    bool validSpeed = false;
+    const double speed = parser.value(speedOption).toDouble(&validSpeed);
+    if (!validSpeed || speed < 0) {
+        qCCritical(lcCapture) << "Invalid replay speed" << parser.value(speedOption);
+        return 1;
+    }
+
+    Replayer replayer(QUrl(parser.value(urlOption)), speed);
+    replayer.setIgnoreSslErrors(parser.isSet(ignoreSslErrorsOption));
+
+    if (!replayer.load(parser.positionalArguments().first())) {
+        return 1;
+    }
+
+    QObject::connect(&replayer, &Replayer::finished, &app, &QCoreApplication::quit, Qt::QueuedConnection);
+    QTimer::singleShot(0, &replayer, &Replayer::start);
+
+    return app.exec();
+}
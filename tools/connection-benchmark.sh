@@ -0,0 +1,53 @@
+#!/bin/sh
+# Runs the server under 10k, 50k and 100k idle and active connections from QMessageLoad and
+# writes the results as a Markdown table. Linux only, needs a hard open file limit above the
+# number of connections.
+#
+# Usage: tools/connection-benchmark.sh <directory with MessageServer and QMessageLoad> [output file]
+# CONNECTIONS, DURATION (seconds) and RATE (requests per second and connection) override the
+# defaults, SERVER_ARGS is passed on to the server to compare configurations.
+
+set -eu
+
+BIN=$(cd "${1:?directory with MessageServer and QMessageLoad}" && pwd)
+OUT=${2:-connection-benchmark.md}
+CONNECTIONS=${CONNECTIONS:-"10000 50000 100000"}
+DURATION=${DURATION:-30}
+RATE=${RATE:-1}
+SERVER_ARGS=${SERVER_ARGS:-}
+PORT=12345
+
+ulimit -n "$(ulimit -H -n)"
+
+{
+    echo "| connections | mode | connected | p50 ms | p99 ms | p99.9 ms | skipped | server CPU % | server RSS MiB |"
+    echo "|---|---|---|---|---|---|---|---|---|"
+} > "$OUT"
+
+for connections in $CONNECTIONS; do
+    for mode in idle active; do
+        workdir=$(mktemp -d)
+
+        # Each run starts from an empty user database in its own directory.
+        (cd "$workdir" && exec "$BIN/MessageServer" -cp "$PORT" -hp 18080 -disableHttps -disableWss \
+            -logRules "qmessage.*.debug=false" $SERVER_ARGS) > "$workdir/server.log" 2>&1 &
+        server=$!
+        sleep 2
+
+        # One loopback address has ports for about 28000 connections.
+        addresses=$((connections / 20000 + 1))
+
+        row=$("$BIN/QMessageLoad" -url "ws://127.0.0.1:$PORT" -connections "$connections" -addresses "$addresses" \
+            -mode "$mode" -rate "$RATE" -duration "$DURATION" -serverPid "$server" -csv)
+
+        kill "$server"
+        wait "$server" || true
+        rm -rf "$workdir"
+
+        echo "$row" | awk -F, \
+            '{ printf "| %s | %s | %s | %s | %s | %s | %s | %s | %d |\n", $2, $1, $3, $9, $10, $11, $8, $12, $13 / 1024 }' >> "$OUT"
+        echo "$mode $connections: $row"
+    done
+done
+
+echo "Results written to $OUT"